@@ -0,0 +1,212 @@
+#include "arith.h"
+#include "flags.h"
+#include "instruction.h"
+#include "sim86.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+bool is_multiply_divide(enum instruction_type type) {
+  return type >= INST_MUL && type <= INST_IDIV;
+}
+
+bool is_shift(enum instruction_type type) {
+  return type >= INST_ROL && type <= INST_SAR;
+}
+
+uint16_t shift_rotate(struct sim86 *sim, enum instruction_type type,
+                      uint16_t value, uint8_t count, uint16_t width) {
+  uint16_t mask = width == 1 ? 0xff : 0xffff;
+  uint16_t sign = width == 1 ? 0x80 : 0x8000;
+
+  if (count == 0) {
+    return value & mask;
+  }
+
+  bool carry = flag_is_set(sim, CF);
+  uint16_t before = value & mask; /* operand of the last step */
+
+  value &= mask;
+
+  for (uint8_t i = 0; i < count; ++i) {
+    bool msb = value & sign;
+    bool lsb = value & 1;
+    before = value;
+
+    switch (type) {
+    case INST_ROL:
+      value = (value << 1) | msb;
+      carry = msb;
+      break;
+
+    case INST_ROR:
+      value = (value >> 1) | (lsb ? sign : 0);
+      carry = lsb;
+      break;
+
+    case INST_RCL:
+      value = (value << 1) | carry;
+      carry = msb;
+      break;
+
+    case INST_RCR:
+      value = (value >> 1) | (carry ? sign : 0);
+      carry = lsb;
+      break;
+
+    case INST_SHL:
+      value <<= 1;
+      carry = msb;
+      break;
+
+    case INST_SHR:
+      value >>= 1;
+      carry = lsb;
+      break;
+
+    case INST_SAR:
+      value = (value >> 1) | (value & sign);
+      carry = lsb;
+      break;
+
+    default:
+      break;
+    }
+
+    value &= mask;
+  }
+
+  /* OF is defined for single bit shifts, the same rule is used for more */
+  bool msb = value & sign;
+  bool overflow = false;
+
+  switch (type) {
+  case INST_ROL:
+  case INST_RCL:
+  case INST_SHL:
+    overflow = msb != carry;
+    break;
+
+  case INST_ROR:
+  case INST_RCR:
+    overflow = msb != (bool)(value & (sign >> 1));
+    break;
+
+  case INST_SHR:
+    overflow = before & sign;
+    break;
+
+  default:
+    break;
+  }
+
+  uint16_t flags = 0;
+  if (type == INST_SHL || type == INST_SHR || type == INST_SAR) {
+    /* shifts set SF, ZF and PF from result like logic operations do */
+    alu_logic(sim, value, width);
+    flags = flags_get(sim);
+  } else {
+    flags = flags_get(sim) & ~(CF | OF);
+  }
+
+  flags |= (carry ? CF : 0) | (overflow ? OF : 0);
+  flags_set(sim, flags);
+
+  return value;
+}
+
+/* CF and OF tell whether upper half of product is significant */
+void multiply_flags(struct sim86 *sim, bool upper) {
+  uint16_t flags = flags_get(sim) & ~(CF | OF);
+  flags_set(sim, flags | (upper ? CF | OF : 0));
+}
+
+bool multiply_divide(struct sim86 *sim, enum instruction_type type,
+                     uint16_t source, uint16_t width) {
+  uint16_t *ax = &sim->regs[Reg_A - 1];
+  uint16_t *dx = &sim->regs[Reg_D - 1];
+
+  if (width == 1) {
+    source &= 0xff;
+
+    switch (type) {
+    case INST_MUL: {
+      *ax = (*ax & 0xff) * source;
+      multiply_flags(sim, *ax >> 8);
+    } break;
+
+    case INST_IMUL: {
+      int16_t product = (int8_t)*ax * (int8_t)source;
+      *ax = product;
+      multiply_flags(sim, product != (int8_t)product);
+    } break;
+
+    case INST_DIV: {
+      if (source == 0 || *ax / source > 0xff) {
+        return false;
+      }
+
+      *ax = (*ax % source) << 8 | *ax / source;
+    } break;
+
+    case INST_IDIV: {
+      int16_t dividend = *ax;
+      int16_t divisor = (int8_t)source;
+      if (divisor == 0 || dividend / divisor > 127 ||
+          dividend / divisor < -127) {
+        return false;
+      }
+
+      *ax = (uint8_t)(dividend % divisor) << 8 | (uint8_t)(dividend / divisor);
+    } break;
+
+    default:
+      break;
+    }
+
+    return true;
+  }
+
+  switch (type) {
+  case INST_MUL: {
+    uint32_t product = (uint32_t)*ax * source;
+    *ax = product;
+    *dx = product >> 16;
+    multiply_flags(sim, *dx != 0);
+  } break;
+
+  case INST_IMUL: {
+    int32_t product = (int32_t)(int16_t)*ax * (int16_t)source;
+    *ax = product;
+    *dx = product >> 16;
+    multiply_flags(sim, product != (int16_t)product);
+  } break;
+
+  case INST_DIV: {
+    uint32_t dividend = (uint32_t)*dx << 16 | *ax;
+    if (source == 0 || dividend / source > 0xffff) {
+      return false;
+    }
+
+    *ax = dividend / source;
+    *dx = dividend % source;
+  } break;
+
+  case INST_IDIV: {
+    /* 64 bits, so -2^31 / -1 does not overflow on the host */
+    int64_t dividend = (int32_t)((uint32_t)*dx << 16 | *ax);
+    int64_t divisor = (int16_t)source;
+    if (divisor == 0 || dividend / divisor > 32767 ||
+        dividend / divisor < -32767) {
+      return false;
+    }
+
+    *ax = dividend / divisor;
+    *dx = dividend % divisor;
+  } break;
+
+  default:
+    break;
+  }
+
+  return true;
+}
@@ -0,0 +1,32 @@
+#ifndef ARITH_H
+#define ARITH_H
+
+#include "instruction.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+struct sim86;
+
+/* MUL, IMUL, DIV and IDIV */
+bool is_multiply_divide(enum instruction_type type);
+
+/* ROL, ROR, RCL, RCR, SHL, SHR and SAR */
+bool is_shift(enum instruction_type type);
+
+/*
+Shifts or rotates value count times, one bit at a time as the 8086 does
+without masking count. Count 0 leaves flags alone, rotates change only CF
+and OF.
+*/
+uint16_t shift_rotate(struct sim86 *sim, enum instruction_type type,
+                      uint16_t value, uint8_t count, uint16_t width);
+
+/*
+Multiplies or divides AL/AX (DX:AX for words) by source. Returns false and
+changes nothing when quotient does not fit or source is zero, where 8086
+raises divide error interrupt.
+*/
+bool multiply_divide(struct sim86 *sim, enum instruction_type type,
+                     uint16_t source, uint16_t width);
+
+#endif // ARITH_H
@@ -0,0 +1,234 @@
+#include "batch.h"
+#include "block.h"
+#include "cache.h"
+#include "execute.h"
+#include "icache.h"
+#include "memory.h"
+#include "sim86.h"
+#include "timer.h"
+#include "watchdog.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct batch_job {
+  char *path;
+  char *variant; /* NULL when listing runs as loaded */
+
+  bool loaded;
+  bool supported; /* false when run stopped at unsupported instruction */
+  char *stopped;  /* why run stopped early, NULL when it ended */
+  uint64_t instructions;
+  uint64_t clocks;
+  uint16_t ax;
+  double cache_miss[CACHE_MAX_LEVELS]; /* percent per level with --cache */
+  uint64_t elapsed_ns;
+  uint64_t cpu_ns;
+};
+
+struct batch {
+  struct batch_job *jobs;
+  size_t count;
+  size_t next; /* next job to take, shared by workers */
+  bool blocks;
+};
+
+/*
+Runs loaded program until ip leaves it or watchdog stops it, returns
+executed instructions.
+*/
+uint64_t batch_execute(struct sim86 *sim, uint16_t end, bool blocks,
+                       bool *supported) {
+  watchdog_start(sim);
+
+  /* divide error ends the run like INT 0 would, it is no missing support */
+  if (blocks) {
+    *supported = block_run(sim, end) || sim->divide_error;
+    return block_instructions(sim);
+  }
+
+  uint64_t instructions = 0;
+  *supported = true;
+
+  while (sim->ip < end) {
+    struct instruction *instruction = icache_get(sim, sim->ip);
+    if (instruction == NULL) {
+      break;
+    }
+
+    if (execute_instruction(sim, instruction).unimplemented) {
+      *supported = sim->divide_error;
+      break;
+    }
+
+    instructions++;
+
+    if (watchdog_active() && watchdog_expired(sim)) {
+      break;
+    }
+  }
+
+  return instructions;
+}
+
+void batch_run_job(struct batch_job *job, bool blocks) {
+  struct sim86 *sim = sim86_create();
+  FILE *fd = fopen(job->path, "rb");
+
+  if (sim == NULL || fd == NULL) {
+    if (fd != NULL) {
+      fclose(fd);
+    }
+
+    sim86_destroy(sim);
+    return;
+  }
+
+  int16_t cnt = mem_load_file(sim, 0, fd);
+  fclose(fd);
+
+  if (cnt < 0) {
+    sim86_destroy(sim);
+    return;
+  }
+
+  job->loaded = true;
+
+  if (job->variant != NULL) {
+    char *line = strdup(job->variant);
+    char *save = NULL;
+
+    for (char *token = strtok_r(line, " \t", &save); token != NULL;
+         token = strtok_r(NULL, " \t", &save)) {
+      sim86_apply_preset(sim, token);
+    }
+
+    free(line);
+  }
+
+  uint64_t start = read_timer_ns();
+  uint64_t cpu_start = read_thread_cpu_ns();
+  job->instructions = batch_execute(sim, cnt, blocks, &job->supported);
+  job->cpu_ns = read_thread_cpu_ns() - cpu_start;
+  job->elapsed_ns = read_timer_ns() - start;
+  job->clocks = sim->total_clocks;
+  job->ax = sim->regs[0];
+  job->stopped =
+      sim->divide_error ? "divide error" : watchdog_stop_name(sim);
+
+  for (uint8_t level = 0; cache_enabled && level < cache_level_count;
+       ++level) {
+    job->cache_miss[level] = cache_miss_rate(sim, level);
+  }
+
+  sim86_destroy(sim);
+}
+
+void *batch_worker(void *arg) {
+  struct batch *batch = arg;
+
+  for (;;) {
+    size_t index = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+    if (index >= batch->count) {
+      return NULL;
+    }
+
+    batch_run_job(&batch->jobs[index], batch->blocks);
+  }
+}
+
+int batch_run(char **paths, int path_count, char **variants,
+              int variant_count, int threads, bool blocks) {
+  int runs_per_path = variant_count > 0 ? variant_count : 1;
+  struct batch batch = {0};
+
+  batch.count = (size_t)path_count * runs_per_path;
+  batch.jobs = calloc(batch.count, sizeof(struct batch_job));
+  batch.blocks = blocks;
+
+  for (int p = 0; p < path_count; ++p) {
+    for (int v = 0; v < runs_per_path; ++v) {
+      struct batch_job *job = &batch.jobs[p * runs_per_path + v];
+      job->path = paths[p];
+      job->variant = variant_count > 0 ? variants[v] : NULL;
+    }
+  }
+
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  pthread_t *workers = calloc(threads, sizeof(pthread_t));
+  uint64_t start = read_timer_ns();
+
+  for (int i = 0; i < threads; ++i) {
+    pthread_create(&workers[i], NULL, batch_worker, &batch);
+  }
+
+  for (int i = 0; i < threads; ++i) {
+    pthread_join(workers[i], NULL);
+  }
+
+  uint64_t elapsed = read_timer_ns() - start;
+
+  uint64_t instructions = 0;
+  uint64_t cpu_ns = 0;
+  int failed = 0;
+
+  for (size_t i = 0; i < batch.count; ++i) {
+    struct batch_job *job = &batch.jobs[i];
+
+    printf("%s", job->path);
+    if (job->variant != NULL && job->variant[0] != '\0') {
+      printf(" [%s]", job->variant);
+    }
+
+    if (!job->loaded) {
+      printf(" -> cannot load\n");
+      failed++;
+      continue;
+    }
+
+    printf(" -> clocks %llu, instructions %llu, ax 0x%x, %.3f ms",
+           (unsigned long long)job->clocks,
+           (unsigned long long)job->instructions, job->ax,
+           job->elapsed_ns / 1e6);
+
+    for (uint8_t level = 0; cache_enabled && level < cache_level_count;
+         ++level) {
+      printf(", L%u miss %.1f%%", level + 1, job->cache_miss[level]);
+    }
+
+    if (!job->supported) {
+      printf(" (unsupported instruction)");
+    } else if (job->stopped != NULL) {
+      printf(" (stopped: %s)", job->stopped);
+    }
+
+    printf("\n");
+
+    failed += !job->supported || job->stopped != NULL;
+    instructions += job->instructions;
+    cpu_ns += job->cpu_ns;
+  }
+
+  double seconds = elapsed / 1e9;
+
+  printf("\nBatch:\n");
+  printf("\truns: %zu (%d failed)\n", batch.count, failed);
+  printf("\tthreads: %d\n", threads);
+  printf("\tinstructions: %llu\n", (unsigned long long)instructions);
+  printf("\twall time: %.3f ms\n", elapsed / 1e6);
+  printf("\tsimulated MIPS: %.2f\n",
+         seconds > 0 ? instructions / seconds / 1e6 : 0.0);
+  printf("\tcpu time: %.3f ms\n", cpu_ns / 1e6);
+  printf("\tparallel speedup: %.2fx\n",
+         elapsed ? (double)cpu_ns / elapsed : 0.0);
+
+  free(workers);
+  free(batch.jobs);
+  return failed;
+}
@@ -0,0 +1,18 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Runs every listing in paths once per variant, each run on its own machine,
+spread over threads worker threads. A variant is a line of input tokens as
+accepted by sim86_apply_preset(), with no variants every listing runs once
+as loaded. Prints per-run results and aggregate throughput, returns number
+of runs that could not be loaded, stopped at an unsupported instruction or
+were stopped by watchdog or a divide error.
+*/
+int batch_run(char **paths, int path_count, char **variants,
+              int variant_count, int threads, bool blocks);
+
+#endif // BATCH_H
@@ -0,0 +1,147 @@
+#include "biu.h"
+#include "clocks.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+uint16_t biu_queue_size(struct biu *biu) {
+  return biu->bus.cpu == CPU_8088 ? 4 : 6;
+}
+
+uint16_t biu_fetch_width(struct biu *biu) {
+  return biu->bus.cpu == CPU_8088 ? 1 : 2;
+}
+
+uint16_t biu_cycle_clocks(struct biu *biu) {
+  return 4 + biu->bus.wait_states;
+}
+
+void biu_reset(struct biu *biu, struct bus_model bus) {
+  *biu = (struct biu){.bus = bus};
+}
+
+/* completes in-flight prefetch */
+void biu_complete_fetch(struct biu *biu) {
+  biu->queue += biu_fetch_width(biu);
+  biu->bus_free = biu->fetch_done;
+  biu->in_flight = false;
+}
+
+/* starts prefetch no earlier than at */
+void biu_start_fetch(struct biu *biu, uint64_t at) {
+  uint64_t start = biu->bus_free > at ? biu->bus_free : at;
+
+  biu->in_flight = true;
+  biu->fetch_done = start + biu_cycle_clocks(biu);
+  biu->stats.fetches++;
+}
+
+/* lets BIU prefetch in background until time */
+void biu_advance(struct biu *biu, uint64_t until) {
+  for (;;) {
+    if (biu->in_flight) {
+      if (biu->fetch_done > until) {
+        return;
+      }
+
+      biu_complete_fetch(biu);
+    }
+
+    if (biu->queue + biu_fetch_width(biu) > biu_queue_size(biu) ||
+        biu->bus_free >= until) {
+      return;
+    }
+
+    biu_start_fetch(biu, biu->bus_free);
+  }
+}
+
+void biu_instruction(struct biu *biu, uint8_t bsize, uint32_t clocks,
+                     uint32_t bus_cycles, bool flush) {
+  uint64_t now = biu->stats.clocks;
+
+  biu_advance(biu, now);
+
+  /* queue was full, so bus stayed idle until now */
+  if (!biu->in_flight && biu->bus_free < now) {
+    biu->bus_free = now;
+  }
+
+  /* EU takes instruction bytes as they arrive */
+  uint16_t needed = bsize;
+  for (;;) {
+    uint16_t taken = biu->queue < needed ? biu->queue : needed;
+    biu->queue -= taken;
+    needed -= taken;
+
+    if (needed == 0) {
+      break;
+    }
+
+    if (!biu->in_flight) {
+      biu_start_fetch(biu, now);
+    }
+
+    biu->stats.fetch_stalls += biu->fetch_done - now;
+    now = biu->fetch_done;
+    biu_complete_fetch(biu);
+  }
+
+  if (biu->bus_free < now) {
+    biu->bus_free = now;
+  }
+
+  /* operand transfers happen at the end of EU time and own the bus */
+  uint32_t transfer_clocks = bus_cycles * biu_cycle_clocks(biu);
+  if (transfer_clocks > clocks) {
+    transfer_clocks = clocks;
+  }
+
+  uint64_t request = now + clocks - transfer_clocks;
+  biu_advance(biu, request);
+
+  uint64_t stall = 0;
+  if (transfer_clocks != 0) {
+    if (biu->in_flight) {
+      stall = biu->fetch_done - request;
+      biu_complete_fetch(biu);
+    }
+
+    biu->bus_free = request + stall + transfer_clocks;
+  }
+
+  biu->stats.bus_stalls += stall;
+  now += clocks + stall;
+
+  if (flush) {
+    biu_advance(biu, now);
+    if (biu->in_flight) {
+      /* bus cycle in progress still runs to the end */
+      biu->bus_free = biu->fetch_done;
+      biu->in_flight = false;
+    }
+
+    biu->queue = 0;
+    biu->stats.flushes++;
+  }
+
+  biu->stats.clocks = now;
+}
+
+void biu_print_stats(struct biu *biu, uint64_t table_clocks) {
+  struct biu_stats *stats = &biu->stats;
+
+  printf("\nBIU model (%s, %d-byte queue, %d wait states):\n",
+         biu->bus.cpu == CPU_8088 ? "8088" : "8086", biu_queue_size(biu),
+         biu->bus.wait_states);
+  printf("\ttable clocks: %llu\n", (unsigned long long)table_clocks);
+  printf("\tbiu clocks: %llu (%+.1f%%)\n", (unsigned long long)stats->clocks,
+         table_clocks
+             ? 100.0 * ((double)stats->clocks - table_clocks) / table_clocks
+             : 0.0);
+  printf("\tprefetch cycles: %llu\n", (unsigned long long)stats->fetches);
+  printf("\tfetch stalls: %llu clocks\n",
+         (unsigned long long)stats->fetch_stalls);
+  printf("\tbus stalls: %llu clocks\n", (unsigned long long)stats->bus_stalls);
+  printf("\tqueue flushes: %llu\n", (unsigned long long)stats->flushes);
+}
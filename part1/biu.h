@@ -0,0 +1,47 @@
+#ifndef BIU_H
+#define BIU_H
+
+#include "clocks.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Bus interface unit model. Runs next to the table clocks and estimates
+cycles with the instruction prefetch queue: the BIU fetches code whenever
+the queue has room and the bus is not used by operand transfers, the EU
+waits when the queue does not hold the next instruction yet, and taken
+jumps empty the queue. Each instance models its own bus, so several can
+follow the same run.
+*/
+
+struct biu_stats {
+  uint64_t clocks;       /* estimated total, comparable to total_clocks */
+  uint64_t fetches;      /* prefetch bus cycles */
+  uint64_t fetch_stalls; /* clocks EU waited for instruction bytes */
+  uint64_t bus_stalls;   /* clocks EU waited for bus to finish a fetch */
+  uint64_t flushes;      /* queue flushes on taken jumps */
+};
+
+/* time is in clocks, same scale as stats.clocks */
+struct biu {
+  struct bus_model bus;
+  uint16_t queue;      /* bytes ready in prefetch queue */
+  bool in_flight;      /* prefetch bus cycle in progress */
+  uint64_t fetch_done; /* when in-flight prefetch completes */
+  uint64_t bus_free;   /* when bus can start next cycle */
+  struct biu_stats stats;
+};
+
+/* Starts with an empty queue and idle bus. */
+void biu_reset(struct biu *biu, struct bus_model bus);
+
+/*
+Runs one instruction of bsize bytes that takes clocks in the EU and makes
+bus_cycles operand transfers, flush is set when it jumped.
+*/
+void biu_instruction(struct biu *biu, uint8_t bsize, uint32_t clocks,
+                     uint32_t bus_cycles, bool flush);
+
+void biu_print_stats(struct biu *biu, uint64_t table_clocks);
+
+#endif // BIU_H
@@ -0,0 +1,376 @@
+#include "block.h"
+#include "arith.h"
+#include "cache.h"
+#include "clocks.h"
+#include "execute.h"
+#include "icache.h"
+#include "instruction.h"
+#include "jit.h"
+#include "profile.h"
+#include "sim86.h"
+#include "timing_model.h"
+#include "watchdog.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void block_flush(struct sim86 *sim) {
+  struct block_cache *cache = sim->blocks;
+
+  for (uint16_t i = 0; i < cache->pool_used; ++i) {
+    cache->map[cache->pool[i].start] = NULL;
+  }
+
+  cache->pool_used = 0;
+  jit_reset(cache);
+  cache->generation = sim->icache.generation;
+  cache->stats.flushes++;
+}
+
+/*
+Instruction is supported when apply_instruction() knows how to run it and
+its clocks do not depend on values, so they can be summed up front.
+*/
+bool block_is_supported(struct instruction *instruction) {
+  switch (instruction->type) {
+  case INST_MOV:
+  case INST_ADD:
+  case INST_SUB:
+  case INST_CMP:
+  case INST_ADC:
+  case INST_SBB:
+  case INST_AND:
+  case INST_OR:
+  case INST_XOR:
+  case INST_TEST:
+  case INST_INC:
+  case INST_DEC:
+  case INST_NEG:
+  case INST_NOT:
+    return true;
+
+  default:
+    /* shift by CL takes 4 clocks per bit */
+    return is_branch(instruction->type) ||
+           (is_shift(instruction->type) && !(instruction->flags & F_V));
+  }
+}
+
+struct block *block_build(struct sim86 *sim, uint16_t start, uint16_t end) {
+  struct block_cache *cache = sim->blocks;
+
+  if (cache->pool_used == BLOCK_POOL_SIZE) {
+    block_flush(sim);
+  }
+
+  struct block *block = &cache->pool[cache->pool_used];
+  *block = (struct block){.start = start};
+
+  uint16_t at = start;
+  while (at < end && block->count < MAX_BLOCK_INSTRUCTIONS) {
+    struct instruction *instruction = icache_get(sim, at);
+    if (instruction == NULL || !block_is_supported(instruction)) {
+      break;
+    }
+
+    block->instructions[block->count] = *instruction;
+    at += instruction->bsize;
+
+    struct timing_state state = {0};
+    if (is_branch(instruction->type)) {
+      state.jumpTaken = true;
+      block->taken_clocks = get_timing(instruction, &state).min;
+      state.jumpTaken = false;
+      block->not_taken_clocks = get_timing(instruction, &state).min;
+      block->clocks[block->count++] = block->not_taken_clocks;
+      block->ends_with_branch = true;
+      break;
+    }
+
+    struct instruction_timing timing = get_timing(instruction, &state);
+    if (memory_transfers(instruction) != 0) {
+      block->memory_mask |= 1u << block->count;
+    }
+
+    uint16_t clocks = timing.min - timing.penalty;
+    block->clocks[block->count++] = clocks;
+    block->body_clocks += clocks;
+  }
+
+  if (block->count == 0) {
+    return NULL;
+  }
+
+  block->end = at;
+  cache->pool_used++;
+  cache->map[start] = block;
+  cache->stats.blocks_built++;
+
+  return block;
+}
+
+/*
+Runs single instruction at ip through the interpreter. Blocks leave out
+instructions whose clocks depend on more than their operands, such as
+repeated string ones. Returns false when it is not implemented at all.
+*/
+bool block_escape(struct sim86 *sim) {
+  struct instruction *instruction = icache_get(sim, sim->ip);
+  if (instruction == NULL || !instruction_is_implemented(instruction)) {
+    return false;
+  }
+
+  if (execute_instruction(sim, instruction).unimplemented) {
+    return false;
+  }
+
+  sim->blocks->stats.instructions++;
+  sim->blocks->stats.escapes++;
+
+  return true;
+}
+
+/*
+Most clocks a run of block can take: every memory operand may be an odd
+word accessed twice, as read and as write, each access with wait states.
+*/
+uint64_t block_max_clocks(struct block *block) {
+  uint32_t branch = block->taken_clocks > block->not_taken_clocks
+                        ? block->taken_clocks
+                        : block->not_taken_clocks;
+  uint32_t memory = __builtin_popcount(block->memory_mask);
+
+  return block->body_clocks + branch +
+         memory * (8 + 4 * (uint64_t)bus_model.wait_states);
+}
+
+struct block *block_lookup(struct sim86 *sim, uint16_t start, uint16_t end) {
+  if (sim->blocks->generation != sim->icache.generation) {
+    block_flush(sim);
+  }
+
+  struct block *block = sim->blocks->map[start];
+  if (block == NULL) {
+    block = block_build(sim, start, end);
+  }
+
+  return block;
+}
+
+bool block_run(struct sim86 *sim, uint16_t end) {
+  if (sim->ip >= end) {
+    return true;
+  }
+
+  if (sim->blocks == NULL) {
+    sim->blocks = calloc(1, sizeof(struct block_cache));
+  }
+
+  struct block_stats *stats = &sim->blocks->stats;
+  struct block *block = block_lookup(sim, sim->ip, end);
+
+  for (;;) {
+    if (block == NULL) {
+      if (!block_escape(sim)) {
+        return false;
+      }
+
+      if (sim->ip >= end || (watchdog_active() && watchdog_expired(sim))) {
+        return true;
+      }
+
+      block = block_lookup(sim, sim->ip, end);
+      continue;
+    }
+
+    /* block that could cross a limit runs one instruction at a time */
+    if (watchdog_active() &&
+        watchdog_would_reach(sim, block->count, block_max_clocks(block))) {
+      block = NULL;
+      continue;
+    }
+
+    struct timing_state state = {0};
+    struct block *next = NULL;
+    uint16_t i = 0;
+    uint16_t at = block->start;
+    bool native = false;
+
+    if (jit_enabled && ++block->runs == jit_threshold) {
+      jit_compile(sim->blocks, block);
+    }
+
+    /* diagnostics that look at every instruction need the loop below */
+    if (block->native != NULL && !timing_models_enabled &&
+        !profile_enabled && !cache_enabled) {
+      uint32_t done = block->native(sim);
+      stats->native_runs++;
+
+      if (sim->blocks->generation != sim->icache.generation) {
+        /* compiled code counted clocks up to the store that hit code */
+        stats->block_runs++;
+        stats->instructions += done;
+        sim->instructions += done;
+        if (sim->ip >= end || (watchdog_active() && watchdog_expired(sim))) {
+          return true;
+        }
+
+        block = block_lookup(sim, sim->ip, end);
+        continue;
+      }
+
+      native = true;
+      i = done;
+      at = sim->ip;
+    }
+
+    for (; i < block->count; ++i) {
+      struct instruction *instruction = &block->instructions[i];
+      uint16_t penalty = 0;
+      state.address = 0;
+
+      if (block->memory_mask & (1u << i)) {
+        state.address = memory_operand_address(sim, instruction);
+        penalty = bus_penalty(&bus_model, instruction, &state);
+        sim->total_clocks += penalty;
+      }
+
+      if (cache_enabled) {
+        cache_fetch(sim, at, instruction->bsize);
+      }
+
+      apply_instruction(sim, instruction, &state);
+
+      if (timing_models_enabled || profile_enabled) {
+        uint16_t clocks = block->clocks[i];
+        if (is_branch(instruction->type) && state.jumpTaken) {
+          clocks = block->taken_clocks;
+        }
+
+        if (timing_models_enabled) {
+          struct timing_event event = {
+              .instruction = instruction,
+              .state = &state,
+              .clocks = clocks,
+              .taken = state.jumpTaken,
+          };
+          timing_models_record(&event);
+        }
+
+        if (profile_enabled) {
+          profile_record(at, instruction->type, clocks + penalty);
+        }
+      }
+
+      at += instruction->bsize;
+
+      if (sim->blocks->generation != sim->icache.generation) {
+        break;
+      }
+    }
+
+    stats->block_runs++;
+
+    if (i < block->count) {
+      /* block overwrote code, so it is no longer valid past this point */
+      for (uint16_t j = 0; j <= i; ++j) {
+        sim->total_clocks += block->clocks[j];
+      }
+
+      stats->instructions += i + 1;
+      sim->instructions += i + 1;
+      if (sim->ip >= end || (watchdog_active() && watchdog_expired(sim))) {
+        return true;
+      }
+
+      block = block_lookup(sim, sim->ip, end);
+      continue;
+    }
+
+    stats->instructions += block->count;
+    sim->instructions += block->count;
+
+    /* compiled body added its clocks itself */
+    if (!native) {
+      sim->total_clocks += block->body_clocks;
+    }
+
+    struct block **successor = &block->not_taken;
+    if (block->ends_with_branch) {
+      if (state.jumpTaken) {
+        sim->total_clocks += block->taken_clocks;
+        successor = &block->taken;
+      } else {
+        sim->total_clocks += block->not_taken_clocks;
+      }
+
+      uint16_t bsize = block->instructions[block->count - 1].bsize;
+      uint16_t branch_ip = block->end - bsize;
+      if (branch_stats_enabled) {
+        branch_record(branch_ip, state.jumpTaken, sim->total_clocks);
+      }
+
+      if (watchdog.detect_hangs && state.jumpTaken && sim->ip <= branch_ip) {
+        watchdog_backward_branch(sim, branch_ip, bsize, sim->ip);
+      }
+    }
+
+    if (sim->ip >= end || (watchdog_active() && watchdog_expired(sim))) {
+      return true;
+    }
+
+    if (*successor != NULL) {
+      stats->chained++;
+      block = *successor;
+      continue;
+    }
+
+    /* lookup may flush the pool, which also drops this block */
+    uint64_t flushes = stats->flushes;
+    next = block_lookup(sim, sim->ip, end);
+
+    if (next != NULL && flushes == stats->flushes) {
+      *successor = next;
+    }
+
+    block = next;
+  }
+}
+
+uint64_t block_instructions(struct sim86 *sim) {
+  return sim->blocks ? sim->blocks->stats.instructions : 0;
+}
+
+void block_print_stats(struct sim86 *sim, uint64_t elapsed_ns) {
+  struct block_stats stats = {0};
+  if (sim->blocks != NULL) {
+    stats = sim->blocks->stats;
+  }
+
+  double seconds = elapsed_ns / 1e9;
+  double ips = seconds > 0 ? stats.instructions / seconds : 0.0;
+
+  printf("\nBlock engine:\n");
+  printf("\tinstructions: %llu\n", (unsigned long long)stats.instructions);
+  printf("\ttime: %.3f ms\n", elapsed_ns / 1e6);
+  printf("\tinstructions per second: %.2f M\n", ips / 1e6);
+  printf("\tns per instruction: %.2f\n",
+         stats.instructions ? (double)elapsed_ns / stats.instructions : 0.0);
+  printf("\tclocks: %llu\n", (unsigned long long)sim->total_clocks);
+  printf("\tblocks built: %llu\n", (unsigned long long)stats.blocks_built);
+  printf("\tblock runs: %llu (%.1f instructions per block)\n",
+         (unsigned long long)stats.block_runs,
+         stats.block_runs ? (double)stats.instructions / stats.block_runs
+                          : 0.0);
+  printf("\tchained transitions: %llu\n", (unsigned long long)stats.chained);
+  printf("\tflushes: %llu\n", (unsigned long long)stats.flushes);
+  printf("\tinterpreted: %llu\n", (unsigned long long)stats.escapes);
+
+  if (jit_enabled) {
+    printf("\tcompiled blocks: %llu (%u bytes of code)\n",
+           (unsigned long long)stats.compiled,
+           sim->blocks ? sim->blocks->code_used : 0);
+    printf("\tnative runs: %llu\n", (unsigned long long)stats.native_runs);
+  }
+}
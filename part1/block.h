@@ -0,0 +1,85 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "branches.h"
+#include "instruction.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MAX_BLOCK_INSTRUCTIONS 32
+#define BLOCK_MAP_SIZE 65536
+#define BLOCK_POOL_SIZE 4096
+
+struct sim86;
+
+/* Compiled body of a block, returns number of instructions it ran. */
+typedef uint32_t (*block_code)(struct sim86 *);
+
+/*
+Straight run of instructions ending at a jump, LOOP or JCXZ. Clocks of the
+body are summed when the block is built so running it costs one add.
+*/
+struct block {
+  uint16_t start;
+  uint16_t end; /* address right after the last instruction */
+  uint16_t count;
+  bool ends_with_branch;
+
+  struct instruction instructions[MAX_BLOCK_INSTRUCTIONS];
+  uint16_t clocks[MAX_BLOCK_INSTRUCTIONS]; /* without bus penalty */
+  uint32_t memory_mask; /* instructions whose bus penalty needs an address */
+
+  uint32_t body_clocks; /* every instruction except a terminating branch */
+  uint16_t taken_clocks;
+  uint16_t not_taken_clocks;
+
+  /* chained successors, resolved on first use */
+  struct block *taken;
+  struct block *not_taken;
+
+  uint32_t runs;
+  block_code native; /* set once block got hot, NULL until then */
+};
+
+struct block_stats {
+  uint64_t instructions;
+  uint64_t block_runs;
+  uint64_t blocks_built;
+  uint64_t chained; /* transitions that skipped the dispatcher */
+  uint64_t flushes;
+  uint64_t escapes; /* instructions run by interpreter between blocks */
+  uint64_t compiled;
+  uint64_t native_runs;
+};
+
+/* blocks of one machine */
+struct block_cache {
+  struct block pool[BLOCK_POOL_SIZE];
+  uint16_t pool_used;
+  struct block *map[BLOCK_MAP_SIZE];
+
+  /* icache generation the current set of blocks was built against */
+  uint64_t generation;
+
+  /* executable buffer compiled blocks live in, see jit.h */
+  uint8_t *code;
+  uint32_t code_used;
+  bool code_unavailable;
+
+  struct block_stats stats;
+};
+
+/*
+Executes code starting at current ip until ip leaves [0, end), watchdog
+stops the run or an unsupported instruction is reached. Returns false in
+the latter case.
+Instructions blocks cannot hold go through execute_instruction().
+*/
+bool block_run(struct sim86 *sim, uint16_t end);
+
+/* Instructions run by block engine so far, 0 before the first block_run(). */
+uint64_t block_instructions(struct sim86 *sim);
+
+void block_print_stats(struct sim86 *sim, uint64_t elapsed_ns);
+
+#endif // BLOCK_H
@@ -0,0 +1,94 @@
+#include "branches.h"
+#include "decode.h"
+#include "display.h"
+#include "execute.h"
+#include "flags.h"
+#include "instruction.h"
+#include "sim86.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BRANCH_REPORT_LIMIT 32
+
+bool branch_stats_enabled = false;
+
+struct branch_site branch_sites[BRANCH_SITES] = {0};
+uint64_t branch_last_clocks = 0;
+
+bool is_branch(enum instruction_type type) {
+  return type >= INST_JO && type <= INST_JCXZ;
+}
+
+bool is_direct_call(struct instruction *instruction) {
+  return instruction->type == INST_CALL &&
+         instruction->operand[0].type == Operand_RelativeImmediate;
+}
+
+bool evaluate_jump(struct sim86 *sim, enum instruction_type type) {
+  switch (type) {
+#define JUMP_CASE(name, condition)                                             \
+  case INST_##name:                                                            \
+    return (condition);
+
+    JUMP_CONDITIONS(JUMP_CASE)
+#undef JUMP_CASE
+
+  default:
+    return false;
+  }
+}
+
+void branch_record(uint16_t ip, bool taken, uint64_t total_clocks) {
+  struct branch_site *site = &branch_sites[ip];
+
+  site->executions++;
+  site->taken += taken;
+  site->clocks += total_clocks - branch_last_clocks;
+  branch_last_clocks = total_clocks;
+}
+
+int compare_sites(const void *a, const void *b) {
+  uint64_t clocks_a = branch_sites[*(const uint16_t *)a].clocks;
+  uint64_t clocks_b = branch_sites[*(const uint16_t *)b].clocks;
+  return (clocks_a < clocks_b) - (clocks_a > clocks_b);
+}
+
+void branch_print_report(struct sim86 *sim) {
+  uint16_t *sites = malloc(BRANCH_SITES * sizeof(*sites));
+  size_t count = 0;
+  uint64_t clocks = 0;
+
+  for (size_t i = 0; i < BRANCH_SITES; ++i) {
+    if (branch_sites[i].executions != 0) {
+      sites[count++] = i;
+      clocks += branch_sites[i].clocks;
+    }
+  }
+
+  qsort(sites, count, sizeof(*sites), compare_sites);
+
+  printf("\nBranch sites:\n");
+  printf("\t    ip  executions   taken       clocks   share  instruction\n");
+
+  for (size_t i = 0; i < count && i < BRANCH_REPORT_LIMIT; ++i) {
+    struct branch_site *site = &branch_sites[sites[i]];
+    struct instruction instruction = {0};
+    decode_instruction(sim, sites[i], &instruction);
+
+    printf("\t0x%04x %11llu  %5.1f%% %12llu  %5.1f%%  ", sites[i],
+           (unsigned long long)site->executions,
+           100.0 * site->taken / site->executions,
+           (unsigned long long)site->clocks,
+           clocks ? 100.0 * site->clocks / clocks : 0.0);
+    print_instruction(&instruction);
+    printf("\n");
+  }
+
+  if (count > BRANCH_REPORT_LIMIT) {
+    printf("\t(%zu more sites)\n", count - BRANCH_REPORT_LIMIT);
+  }
+
+  free(sites);
+}
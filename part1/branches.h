@@ -0,0 +1,65 @@
+#ifndef BRANCHES_H
+#define BRANCHES_H
+
+#include "instruction.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+struct sim86;
+
+#define BRANCH_CX (sim->regs[Reg_C - 1])
+
+/*
+Condition under which each jump is taken, LOOPs decrement CX first.
+Expanded where a `struct sim86 *sim` is in scope.
+*/
+// clang-format off
+#define JUMP_CONDITIONS(X)                                                     \
+  X(JO, flag_is_set(sim, OF))                                                  \
+  X(JNO, !flag_is_set(sim, OF))                                                \
+  X(JB, flag_is_set(sim, CF))                                                  \
+  X(JAE, !flag_is_set(sim, CF))                                                \
+  X(JZ, flag_is_set(sim, ZF))                                                  \
+  X(JNZ, !flag_is_set(sim, ZF))                                                \
+  X(JBE, flag_is_set(sim, CF) || flag_is_set(sim, ZF))                         \
+  X(JA, !flag_is_set(sim, CF) && !flag_is_set(sim, ZF))                        \
+  X(JS, flag_is_set(sim, SF))                                                  \
+  X(JNS, !flag_is_set(sim, SF))                                                \
+  X(JP, flag_is_set(sim, PF))                                                  \
+  X(JPO, !flag_is_set(sim, PF))                                                \
+  X(JL, flag_is_set(sim, SF) != flag_is_set(sim, OF))                          \
+  X(JGE, flag_is_set(sim, SF) == flag_is_set(sim, OF))                         \
+  X(JLE, flag_is_set(sim, ZF) || flag_is_set(sim, SF) != flag_is_set(sim, OF)) \
+  X(JG, !flag_is_set(sim, ZF) && flag_is_set(sim, SF) == flag_is_set(sim, OF)) \
+  X(JMP, true)                                                                 \
+  X(LOOP, --BRANCH_CX != 0)                                                    \
+  X(LOOPZ, --BRANCH_CX != 0 && flag_is_set(sim, ZF))                           \
+  X(LOOPNZ, --BRANCH_CX != 0 && !flag_is_set(sim, ZF))                         \
+  X(JCXZ, BRANCH_CX == 0)
+// clang-format on
+
+struct branch_site {
+  uint64_t executions;
+  uint64_t taken;
+  uint64_t clocks; /* clocks since previous branch, this one included */
+};
+
+#define BRANCH_SITES 65536
+
+extern bool branch_stats_enabled;
+extern struct branch_site branch_sites[BRANCH_SITES];
+
+bool is_branch(enum instruction_type type);
+
+/* Near CALL whose target is encoded in the instruction. */
+bool is_direct_call(struct instruction *instruction);
+
+/* Evaluates jump condition of a branch, decrementing CX for LOOPs. */
+bool evaluate_jump(struct sim86 *sim, enum instruction_type type);
+
+/* Records branch at ip, total_clocks is the counter after it executed. */
+void branch_record(uint16_t ip, bool taken, uint64_t total_clocks);
+
+void branch_print_report(struct sim86 *sim);
+
+#endif // BRANCHES_H
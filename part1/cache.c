@@ -0,0 +1,374 @@
+#include "cache.h"
+#include "decode.h"
+#include "display.h"
+#include "instruction.h"
+#include "memory.h"
+#include "sim86.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_REPORT_LIMIT 32
+
+bool cache_enabled = false;
+struct cache_config cache_configs[CACHE_MAX_LEVELS] = {0};
+uint8_t cache_level_count = 0;
+
+char *cache_policy_names[] = {"lru", "fifo", "random"};
+char *cache_kind_names[] = {"fetch", "read", "write"};
+
+bool is_power_of_two(uint32_t value) {
+  return value != 0 && (value & (value - 1)) == 0;
+}
+
+/* Parses one level of cache_configure() spec, leaves spec after it. */
+bool cache_parse_level(char **spec, struct cache_config *config) {
+  char *end = NULL;
+  unsigned long values[3];
+
+  for (int i = 0; i < 3; ++i) {
+    values[i] = strtoul(*spec, &end, 0);
+    if (end == *spec) {
+      return false;
+    }
+
+    if (i == 0 && (*end == 'k' || *end == 'K')) {
+      values[i] *= 1024;
+      end++;
+    }
+
+    bool last = i == 2;
+    if (*end != ':' && !(last && (*end == ',' || *end == '\0'))) {
+      return false;
+    }
+
+    *spec = *end == ':' && !last ? end + 1 : end;
+  }
+
+  config->size = values[0];
+  config->line_size = values[1];
+  config->ways = values[2];
+  config->policy = CACHE_LRU;
+
+  if (**spec == ':') {
+    char *name = *spec + 1;
+    size_t length = strcspn(name, ",");
+    bool found = false;
+
+    for (int policy = CACHE_LRU; policy <= CACHE_RANDOM; ++policy) {
+      if (strlen(cache_policy_names[policy]) == length &&
+          strncmp(name, cache_policy_names[policy], length) == 0) {
+        config->policy = policy;
+        found = true;
+      }
+    }
+
+    if (!found) {
+      return false;
+    }
+
+    *spec = name + length;
+  }
+
+  /* set index is taken from address bits, so sets are a power of two */
+  if (!is_power_of_two(config->line_size) || config->line_size > MEM_SIZE ||
+      config->ways == 0) {
+    return false;
+  }
+
+  uint32_t set_size = config->line_size * config->ways;
+  return config->size % set_size == 0 &&
+         is_power_of_two(config->size / set_size);
+}
+
+bool cache_configure(char *spec) {
+  struct cache_config configs[CACHE_MAX_LEVELS];
+  uint8_t count = 0;
+
+  while (*spec) {
+    if (count == CACHE_MAX_LEVELS ||
+        !cache_parse_level(&spec, &configs[count])) {
+      return false;
+    }
+
+    count++;
+    spec += *spec == ',';
+  }
+
+  if (count == 0) {
+    return false;
+  }
+
+  memcpy(cache_configs, configs, count * sizeof(*configs));
+  cache_level_count = count;
+  cache_enabled = true;
+  return true;
+}
+
+/* Returns cache of machine, empty levels are set up on first use. */
+struct cache_state *cache_get(struct sim86 *sim) {
+  if (sim->cache != NULL) {
+    return sim->cache;
+  }
+
+  struct cache_state *cache = calloc(1, sizeof(*cache));
+  cache->rng = 0x2545F4914F6CDD1Dull;
+
+  for (uint8_t i = 0; i < cache_level_count; ++i) {
+    struct cache_config *config = &cache_configs[i];
+    struct cache_level *level = &cache->levels[i];
+
+    level->config = *config;
+    level->sets = config->size / (config->line_size * config->ways);
+    level->lines = calloc(level->sets * config->ways, sizeof(*level->lines));
+  }
+
+  sim->cache = cache;
+  return cache;
+}
+
+/*
+Looks up line holding addr in level index and fills it on miss, first from
+the next level. Returns index of level that had the line, level count when
+it came from memory.
+*/
+uint8_t cache_lookup(struct cache_state *cache, uint8_t index, uint32_t addr,
+                     enum cache_access kind, bool write) {
+  struct cache_level *level = &cache->levels[index];
+  uint32_t ways = level->config.ways;
+  uint32_t line = addr / level->config.line_size;
+  uint32_t set = line & (level->sets - 1);
+  uint32_t tag = line / level->sets;
+  struct cache_line *lines = &level->lines[set * ways];
+  struct cache_line *victim = &lines[0];
+
+  level->accesses[kind]++;
+  cache->clock++;
+
+  for (uint32_t way = 0; way < ways; ++way) {
+    struct cache_line *candidate = &lines[way];
+
+    if (candidate->valid && candidate->tag == tag) {
+      if (level->config.policy == CACHE_LRU) {
+        candidate->stamp = cache->clock;
+      }
+
+      candidate->dirty |= write;
+      return index;
+    }
+
+    /* empty way first, then the oldest one */
+    if (victim->valid &&
+        (!candidate->valid || candidate->stamp < victim->stamp)) {
+      victim = candidate;
+    }
+  }
+
+  level->misses[kind]++;
+
+  if (victim->valid && level->config.policy == CACHE_RANDOM) {
+    cache->rng ^= cache->rng << 13;
+    cache->rng ^= cache->rng >> 7;
+    cache->rng ^= cache->rng << 17;
+    victim = &lines[cache->rng % ways];
+  }
+
+  bool has_next = index + 1 < cache_level_count;
+
+  if (victim->valid && victim->dirty) {
+    level->write_backs++;
+
+    if (has_next) {
+      uint32_t evicted =
+          (victim->tag * level->sets + set) * level->config.line_size;
+      cache_lookup(cache, index + 1, evicted, CACHE_WRITE, true);
+    }
+  }
+
+  *victim = (struct cache_line){
+      .tag = tag, .stamp = cache->clock, .valid = true, .dirty = write};
+
+  return has_next ? cache_lookup(cache, index + 1, addr, kind, false)
+                  : cache_level_count;
+}
+
+void cache_fetch(struct sim86 *sim, uint16_t ip, uint16_t size) {
+  cache_get(sim)->ip = ip;
+  cache_access(sim, ip, size, CACHE_FETCH);
+}
+
+void cache_access(struct sim86 *sim, uint16_t addr, uint16_t size,
+                  enum cache_access kind) {
+  struct cache_state *cache = cache_get(sim);
+  uint32_t line_size = cache_configs[0].line_size;
+  uint32_t first = addr / line_size;
+  uint32_t last = (addr + size - 1u) / line_size;
+  struct cache_site *site = &cache->sites[cache->ip];
+
+  for (uint32_t line = first; line <= last; ++line) {
+    /* access running past end of memory wraps to its start */
+    uint16_t at = line == first ? addr : line * line_size;
+    struct cache_site *region = &cache->regions[at / CACHE_REGION_SIZE];
+    uint8_t hit = cache_lookup(cache, 0, at, kind, kind == CACHE_WRITE);
+
+    site->accesses++;
+    region->accesses++;
+
+    for (uint8_t level = 0; level < hit; ++level) {
+      site->misses[level]++;
+      region->misses[level]++;
+    }
+  }
+}
+
+double miss_rate(uint64_t misses, uint64_t accesses) {
+  return accesses ? 100.0 * misses / accesses : 0.0;
+}
+
+double cache_miss_rate(struct sim86 *sim, uint8_t level) {
+  struct cache_level *counted = &cache_get(sim)->levels[level];
+  uint64_t accesses = 0;
+  uint64_t misses = 0;
+
+  for (int kind = 0; kind < CACHE_KINDS; ++kind) {
+    accesses += counted->accesses[kind];
+    misses += counted->misses[kind];
+  }
+
+  return miss_rate(misses, accesses);
+}
+
+void cache_print_level(struct cache_state *cache, uint8_t index) {
+  struct cache_level *level = &cache->levels[index];
+  struct cache_config *config = &level->config;
+  uint64_t accesses = 0;
+  uint64_t misses = 0;
+
+  printf("\nL%u cache (%u bytes, %u-byte lines, %u-way, %u sets, %s):\n",
+         index + 1, config->size, config->line_size, config->ways,
+         level->sets, cache_policy_names[config->policy]);
+  printf("\t  kind     accesses       misses   miss%%\n");
+
+  for (int kind = 0; kind < CACHE_KINDS; ++kind) {
+    accesses += level->accesses[kind];
+    misses += level->misses[kind];
+
+    printf("\t%6s %12llu %12llu  %5.1f%%\n", cache_kind_names[kind],
+           (unsigned long long)level->accesses[kind],
+           (unsigned long long)level->misses[kind],
+           miss_rate(level->misses[kind], level->accesses[kind]));
+  }
+
+  printf("\t%6s %12llu %12llu  %5.1f%%\n", "total",
+         (unsigned long long)accesses, (unsigned long long)misses,
+         miss_rate(misses, accesses));
+  printf("\twrite-backs: %llu\n", (unsigned long long)level->write_backs);
+}
+
+/* prints misses of a site at every level, rates relative to its accesses */
+void cache_print_site(struct cache_site *site) {
+  printf("%12llu", (unsigned long long)site->accesses);
+
+  for (uint8_t level = 0; level < cache_level_count; ++level) {
+    printf(" %10llu %5.1f%%", (unsigned long long)site->misses[level],
+           miss_rate(site->misses[level], site->accesses));
+  }
+}
+
+void cache_print_header(char *first_column) {
+  printf("\t%s     accesses", first_column);
+
+  for (uint8_t level = 0; level < cache_level_count; ++level) {
+    printf("  L%u misses  miss%%", level + 1);
+  }
+}
+
+/* sites of machine being reported, qsort() passes no context */
+struct cache_site *sorted_sites = NULL;
+
+int compare_cache_sites(const void *a, const void *b) {
+  struct cache_site *site_a = &sorted_sites[*(const uint16_t *)a];
+  struct cache_site *site_b = &sorted_sites[*(const uint16_t *)b];
+  uint8_t last = cache_level_count - 1;
+
+  /* misses that went all the way to memory cost most */
+  if (site_a->misses[last] != site_b->misses[last]) {
+    return (site_a->misses[last] < site_b->misses[last]) -
+           (site_a->misses[last] > site_b->misses[last]);
+  }
+
+  return (site_a->misses[0] < site_b->misses[0]) -
+         (site_a->misses[0] > site_b->misses[0]);
+}
+
+void cache_print_report(struct sim86 *sim) {
+  struct cache_state *cache = cache_get(sim);
+
+  for (uint8_t level = 0; level < cache_level_count; ++level) {
+    cache_print_level(cache, level);
+  }
+
+  uint16_t *sites = malloc(MEM_SIZE * sizeof(*sites));
+  size_t count = 0;
+
+  for (size_t i = 0; i < MEM_SIZE; ++i) {
+    if (cache->sites[i].accesses != 0) {
+      sites[count++] = i;
+    }
+  }
+
+  sorted_sites = cache->sites;
+  qsort(sites, count, sizeof(*sites), compare_cache_sites);
+
+  printf("\nCache misses by instruction:\n");
+  cache_print_header("    ip");
+  printf("  instruction\n");
+
+  for (size_t i = 0; i < count && i < CACHE_REPORT_LIMIT; ++i) {
+    struct instruction instruction = {0};
+    decode_instruction(sim, sites[i], &instruction);
+
+    printf("\t0x%04x ", sites[i]);
+    cache_print_site(&cache->sites[sites[i]]);
+    printf("  ");
+    print_instruction(&instruction);
+    printf("\n");
+  }
+
+  if (count > CACHE_REPORT_LIMIT) {
+    printf("\t(%zu more instructions)\n", count - CACHE_REPORT_LIMIT);
+  }
+
+  printf("\nCache misses by region:\n");
+  cache_print_header("       region");
+  printf("\n");
+
+  for (size_t i = 0; i < CACHE_REGIONS; ++i) {
+    struct cache_site *region = &cache->regions[i];
+    if (region->accesses == 0) {
+      continue;
+    }
+
+    printf("\t0x%04zx-0x%04zx ", i * CACHE_REGION_SIZE,
+           (i + 1) * CACHE_REGION_SIZE - 1);
+    cache_print_site(region);
+    printf("\n");
+  }
+
+  free(sites);
+}
+
+void cache_free(struct sim86 *sim) {
+  if (sim->cache == NULL) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < CACHE_MAX_LEVELS; ++i) {
+    free(sim->cache->levels[i].lines);
+  }
+
+  free(sim->cache);
+  sim->cache = NULL;
+}
@@ -0,0 +1,95 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "memory.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Cache model fed by every memory access of the simulated program: fetches
+of executed instructions, reads through mem_read_byte()/mem_read_word()
+and writes through mem_save_byte()/mem_save_word(). The 8086 has no cache,
+the model shows how access patterns of a program would behave on one.
+
+Levels are write-back and write-allocate. Second level, when configured,
+sees misses and write-backs of the first one.
+*/
+
+#define CACHE_MAX_LEVELS 2
+#define CACHE_REGION_SIZE 1024
+#define CACHE_REGIONS (MEM_SIZE / CACHE_REGION_SIZE)
+
+struct sim86;
+
+enum cache_policy { CACHE_LRU, CACHE_FIFO, CACHE_RANDOM };
+
+enum cache_access { CACHE_FETCH, CACHE_READ, CACHE_WRITE, CACHE_KINDS };
+
+struct cache_config {
+  uint32_t size; /* bytes */
+  uint32_t line_size;
+  uint32_t ways;
+  enum cache_policy policy;
+};
+
+struct cache_line {
+  uint32_t tag;
+  uint64_t stamp; /* last use for LRU, fill for FIFO */
+  bool valid;
+  bool dirty;
+};
+
+struct cache_level {
+  struct cache_config config;
+  uint32_t sets;
+  struct cache_line *lines; /* sets * ways, ways of a set next to each other */
+
+  uint64_t accesses[CACHE_KINDS];
+  uint64_t misses[CACHE_KINDS];
+  uint64_t write_backs;
+};
+
+struct cache_site {
+  uint64_t accesses;
+  uint64_t misses[CACHE_MAX_LEVELS];
+};
+
+/* Cache contents and counters of one machine. */
+struct cache_state {
+  struct cache_level levels[CACHE_MAX_LEVELS];
+  struct cache_site sites[MEM_SIZE];
+  struct cache_site regions[CACHE_REGIONS];
+  uint64_t clock; /* counts line lookups, orders LRU and FIFO */
+  uint64_t rng;
+  uint16_t ip; /* instruction whose accesses are being recorded */
+};
+
+/* Geometry of every level, shared by all machines. */
+extern bool cache_enabled;
+extern struct cache_config cache_configs[CACHE_MAX_LEVELS];
+extern uint8_t cache_level_count;
+
+/*
+Parses "SIZE:LINE:WAYS[:POLICY][,SIZE:LINE:WAYS[:POLICY]]", one entry per
+level. SIZE takes k suffix, POLICY is lru (default), fifo or random.
+Sets up levels and enables model, false on malformed or impossible
+geometry.
+*/
+bool cache_configure(char *spec);
+
+/* Records fetch of instruction at ip, its accesses are recorded after it. */
+void cache_fetch(struct sim86 *sim, uint16_t ip, uint16_t size);
+
+/* Records access of size bytes, split into lines it touches. */
+void cache_access(struct sim86 *sim, uint16_t addr, uint16_t size,
+                  enum cache_access kind);
+
+/* Percentage of accesses to level that missed, over the whole run. */
+double cache_miss_rate(struct sim86 *sim, uint8_t level);
+
+/* Hit rates per level, per instruction address and per memory region. */
+void cache_print_report(struct sim86 *sim);
+
+void cache_free(struct sim86 *sim);
+
+#endif // CACHE_H
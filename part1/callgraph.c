@@ -0,0 +1,239 @@
+#include "callgraph.h"
+#include "instruction.h"
+#include "memory.h"
+#include "sim86.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CALLGRAPH_REPORT_LIMIT 32
+
+bool callgraph_enabled = false;
+
+/* calling context tree, parents come before their children */
+struct callgraph_node *callgraph_nodes = NULL;
+int32_t callgraph_node_count = 0;
+int32_t callgraph_node_capacity = 0;
+
+struct callgraph_frame callgraph_frames[CALLGRAPH_MAX_DEPTH];
+int32_t callgraph_depth = 0;
+int32_t callgraph_max_depth = 0;
+int32_t callgraph_current = 0;
+uint64_t callgraph_last_clocks = 0;
+
+/* totals per function, filled in by callgraph_print_report() */
+struct callgraph_function {
+  uint64_t calls;
+  uint64_t inclusive;
+  uint64_t exclusive;
+};
+
+struct callgraph_function callgraph_functions[MEM_SIZE];
+
+int32_t callgraph_add_node(uint16_t function, int32_t parent) {
+  if (callgraph_node_count == callgraph_node_capacity) {
+    callgraph_node_capacity =
+        callgraph_node_capacity ? callgraph_node_capacity * 2 : 256;
+    callgraph_nodes =
+        realloc(callgraph_nodes,
+                callgraph_node_capacity * sizeof(*callgraph_nodes));
+  }
+
+  int32_t index = callgraph_node_count++;
+  callgraph_nodes[index] = (struct callgraph_node){
+      .function = function,
+      .parent = parent,
+      .first_child = -1,
+      .next_sibling = -1,
+  };
+
+  if (parent >= 0) {
+    callgraph_nodes[index].next_sibling = callgraph_nodes[parent].first_child;
+    callgraph_nodes[parent].first_child = index;
+  }
+
+  return index;
+}
+
+/* Charges clocks since previous change of stack to function on top. */
+void callgraph_charge(struct sim86 *sim) {
+  callgraph_nodes[callgraph_current].clocks +=
+      sim->total_clocks - callgraph_last_clocks;
+  callgraph_last_clocks = sim->total_clocks;
+}
+
+void callgraph_start(struct sim86 *sim) {
+  if (callgraph_node_count == 0) {
+    callgraph_add_node(sim->ip, -1);
+    callgraph_nodes[0].calls = 1;
+  }
+
+  callgraph_current = 0;
+  callgraph_depth = 0;
+  callgraph_last_clocks = sim->total_clocks;
+}
+
+void callgraph_record(struct sim86 *sim, enum instruction_type type,
+                      uint16_t sp) {
+  /* CALL itself is spent in caller, RET in callee */
+  callgraph_charge(sim);
+
+  if (type == INST_RET) {
+    while (callgraph_depth > 0 &&
+           callgraph_frames[callgraph_depth - 1].sp <= sp) {
+      callgraph_depth--;
+    }
+
+    callgraph_current =
+        callgraph_depth ? callgraph_frames[callgraph_depth - 1].node : 0;
+    return;
+  }
+
+  /* stack wrapped around, deeper calls are charged to this one */
+  if (callgraph_depth == CALLGRAPH_MAX_DEPTH) {
+    return;
+  }
+
+  int32_t child = callgraph_nodes[callgraph_current].first_child;
+  while (child >= 0 && callgraph_nodes[child].function != sim->ip) {
+    child = callgraph_nodes[child].next_sibling;
+  }
+
+  if (child < 0) {
+    child = callgraph_add_node(sim->ip, callgraph_current);
+  }
+
+  callgraph_nodes[child].calls++;
+  callgraph_frames[callgraph_depth++] = (struct callgraph_frame){child, sp};
+  callgraph_current = child;
+
+  if (callgraph_depth > callgraph_max_depth) {
+    callgraph_max_depth = callgraph_depth;
+  }
+}
+
+/* Whether function of node is also one of its callers, as in recursion. */
+bool callgraph_is_recursive(int32_t node) {
+  uint16_t function = callgraph_nodes[node].function;
+
+  for (int32_t n = callgraph_nodes[node].parent; n >= 0;
+       n = callgraph_nodes[n].parent) {
+    if (callgraph_nodes[n].function == function) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+int compare_functions(const void *a, const void *b) {
+  uint64_t clocks_a = callgraph_functions[*(const uint16_t *)a].inclusive;
+  uint64_t clocks_b = callgraph_functions[*(const uint16_t *)b].inclusive;
+  return (clocks_a < clocks_b) - (clocks_a > clocks_b);
+}
+
+void callgraph_print_report(struct sim86 *sim) {
+  if (callgraph_node_count == 0) {
+    return;
+  }
+
+  callgraph_charge(sim);
+
+  /* children come after parents, so one backward pass sums subtrees */
+  uint64_t *subtree = malloc(callgraph_node_count * sizeof(*subtree));
+  for (int32_t i = 0; i < callgraph_node_count; ++i) {
+    subtree[i] = callgraph_nodes[i].clocks;
+  }
+
+  for (int32_t i = callgraph_node_count - 1; i > 0; --i) {
+    subtree[callgraph_nodes[i].parent] += subtree[i];
+  }
+
+  for (size_t i = 0; i < MEM_SIZE; ++i) {
+    callgraph_functions[i] = (struct callgraph_function){0};
+  }
+
+  for (int32_t i = 0; i < callgraph_node_count; ++i) {
+    struct callgraph_node *node = &callgraph_nodes[i];
+    struct callgraph_function *function = &callgraph_functions[node->function];
+
+    function->calls += node->calls;
+    function->exclusive += node->clocks;
+
+    /* recursive calls are already inside clocks of outermost one */
+    if (!callgraph_is_recursive(i)) {
+      function->inclusive += subtree[i];
+    }
+  }
+
+  uint64_t clocks = subtree[0];
+  free(subtree);
+
+  uint16_t *functions = malloc(MEM_SIZE * sizeof(*functions));
+  size_t count = 0;
+
+  for (size_t i = 0; i < MEM_SIZE; ++i) {
+    if (callgraph_functions[i].calls != 0) {
+      functions[count++] = i;
+    }
+  }
+
+  qsort(functions, count, sizeof(*functions), compare_functions);
+
+  printf("\nCall graph:\n");
+  printf("\tfunctions: %zu, call paths: %d, deepest stack: %d\n", count,
+         callgraph_node_count, callgraph_max_depth);
+  printf("\tfunction       calls    inclusive   share    exclusive   share\n");
+
+  for (size_t i = 0; i < count && i < CALLGRAPH_REPORT_LIMIT; ++i) {
+    struct callgraph_function *function = &callgraph_functions[functions[i]];
+
+    printf("\t  0x%04x %11llu %12llu  %5.1f%% %12llu  %5.1f%%\n",
+           functions[i], (unsigned long long)function->calls,
+           (unsigned long long)function->inclusive,
+           clocks ? 100.0 * function->inclusive / clocks : 0.0,
+           (unsigned long long)function->exclusive,
+           clocks ? 100.0 * function->exclusive / clocks : 0.0);
+  }
+
+  if (count > CALLGRAPH_REPORT_LIMIT) {
+    printf("\t(%zu more functions)\n", count - CALLGRAPH_REPORT_LIMIT);
+  }
+
+  free(functions);
+}
+
+bool callgraph_write_collapsed(struct sim86 *sim, char *path) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    return false;
+  }
+
+  if (callgraph_node_count != 0) {
+    callgraph_charge(sim);
+  }
+
+  int32_t *stack = malloc((CALLGRAPH_MAX_DEPTH + 1) * sizeof(*stack));
+
+  for (int32_t i = 0; i < callgraph_node_count; ++i) {
+    if (callgraph_nodes[i].clocks == 0) {
+      continue;
+    }
+
+    int32_t depth = 0;
+    for (int32_t n = i; n >= 0; n = callgraph_nodes[n].parent) {
+      stack[depth++] = n;
+    }
+
+    while (depth-- > 0) {
+      fprintf(f, "0x%04x%c", callgraph_nodes[stack[depth]].function,
+              depth ? ';' : ' ');
+    }
+
+    fprintf(f, "%llu\n", (unsigned long long)callgraph_nodes[i].clocks);
+  }
+
+  free(stack);
+  return fclose(f) == 0;
+}
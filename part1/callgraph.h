@@ -0,0 +1,57 @@
+#ifndef CALLGRAPH_H
+#define CALLGRAPH_H
+
+#include "instruction.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* return addresses 64 KB of stack can hold */
+#define CALLGRAPH_MAX_DEPTH 32768
+
+struct sim86;
+
+/*
+Shadow call stack over near CALL and RET. Functions are identified by call
+target, the code a run starts in is the root function. Clocks are charged
+to the function on top of the stack whenever it changes, so instructions in
+between need no hook and blocks keep running compiled. RET unwinds every
+frame at or below SP it pops from, which copes with code that discards
+frames without returning.
+*/
+struct callgraph_node {
+  uint16_t function;
+  int32_t parent; /* -1 for root */
+  int32_t first_child;
+  int32_t next_sibling;
+  uint64_t calls;
+  uint64_t clocks; /* exclusive, spent in function itself */
+};
+
+struct callgraph_frame {
+  int32_t node;
+  uint16_t sp; /* where CALL stored return address */
+};
+
+extern bool callgraph_enabled;
+
+/* Starts a run at current ip with an empty call stack. */
+void callgraph_start(struct sim86 *sim);
+
+/*
+Records CALL or RET that has just run, sp is the stack address its return
+address was stored to or popped from.
+*/
+void callgraph_record(struct sim86 *sim, enum instruction_type type,
+                      uint16_t sp);
+
+/* Prints calls, inclusive and exclusive clocks of every function. */
+void callgraph_print_report(struct sim86 *sim);
+
+/*
+Writes every call stack with the clocks spent on its top as one
+"root;caller;callee clocks" line, the input of flame graph tools. Returns
+false when path cannot be written.
+*/
+bool callgraph_write_collapsed(struct sim86 *sim, char *path);
+
+#endif // CALLGRAPH_H
@@ -0,0 +1,389 @@
+#include "cfg.h"
+#include "branches.h"
+#include "clocks.h"
+#include "decode.h"
+#include "display.h"
+#include "instruction.h"
+#include "memory.h"
+#include "sim86.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CFG_REPORT_LIMIT 64
+#define GUESSED_TAKEN_PROBABILITY 0.5
+#define MAX_CYCLIC_PROBABILITY 0.999999999
+
+uint32_t cfg_trip_counts[MEM_SIZE] = {0};
+
+bool cfg_parse_trip_counts(char *spec) {
+  while (*spec) {
+    char *end = NULL;
+    unsigned long ip = strtoul(spec, &end, 0);
+    if (end == spec || *end != ':' || ip >= MEM_SIZE) {
+      return false;
+    }
+
+    spec = end + 1;
+    unsigned long trips = strtoul(spec, &end, 0);
+    if (end == spec || trips == 0 || (*end != ',' && *end != '\0')) {
+      return false;
+    }
+
+    cfg_trip_counts[ip] = trips;
+    spec = *end == ',' ? end + 1 : end;
+  }
+
+  return true;
+}
+
+void cfg_close_block(struct cfg_block *block, struct instruction *branch,
+                     uint16_t at) {
+  struct timing_state state = {0};
+
+  block->ends_with_branch = true;
+  block->conditional = branch->type != INST_JMP;
+  block->branch = branch->type;
+  block->branch_ip = at;
+  block->target = at + branch->bsize + branch->operand[0].immediate;
+
+  state.jumpTaken = true;
+  block->taken_clocks = get_timing(branch, &state).min;
+  state.jumpTaken = false;
+  block->not_taken_clocks = get_timing(branch, &state).min;
+}
+
+struct cfg *cfg_build(struct sim86 *sim, uint16_t size) {
+  struct cfg *cfg = calloc(1, sizeof(*cfg));
+  struct instruction *decoded = malloc((size + 1) * sizeof(*decoded));
+  uint16_t *addresses = malloc((size + 1) * sizeof(*addresses));
+  bool *starts = calloc(MEM_SIZE, sizeof(*starts));
+  bool *leaders = calloc(MEM_SIZE, sizeof(*leaders));
+
+  size_t used = 0;
+  size_t count = decode_range(sim->memory, size, decoded, size, &used);
+
+  uint16_t at = 0;
+  for (size_t i = 0; i < count; ++i) {
+    addresses[i] = at;
+    starts[at] = true;
+    at += decoded[i].bsize;
+  }
+
+  /*
+  Blocks start at entry, at jump and call targets and right after branches.
+  Calls are not edges, code after one continues the block.
+  */
+  leaders[0] = true;
+  for (size_t i = 0; i < count; ++i) {
+    struct instruction *inst = &decoded[i];
+    uint32_t next = addresses[i] + inst->bsize;
+    uint16_t target = next + inst->operand[0].immediate;
+
+    if (is_direct_call(inst) && target < used && starts[target]) {
+      leaders[target] = true;
+      cfg->labeled[target] = true;
+    }
+
+    if (!is_branch(inst->type)) {
+      continue;
+    }
+
+    if (next < used) {
+      leaders[next] = true;
+    }
+
+    if (target < used && starts[target]) {
+      leaders[target] = true;
+      cfg->labeled[target] = true;
+    } else {
+      cfg->unresolved++;
+    }
+  }
+
+  for (uint32_t addr = 0; addr < MEM_SIZE; ++addr) {
+    cfg->block_at[addr] = CFG_NO_BLOCK;
+  }
+
+  cfg->blocks = calloc(count + 1, sizeof(*cfg->blocks));
+  cfg->instructions = count;
+
+  struct cfg_block *block = NULL;
+  for (size_t i = 0; i < count; ++i) {
+    struct instruction *inst = &decoded[i];
+    uint16_t address = addresses[i];
+
+    if (block == NULL || leaders[address]) {
+      block = &cfg->blocks[cfg->count];
+      *block = (struct cfg_block){.start = address};
+      cfg->block_at[address] = cfg->count++;
+    }
+
+    block->count++;
+    block->end = address + inst->bsize;
+
+    if (is_branch(inst->type)) {
+      cfg_close_block(block, inst, address);
+      block = NULL;
+      continue;
+    }
+
+    /* address of memory operand is only known when direct */
+    struct timing_state state = {0};
+    for (int op = 0; op < 2; ++op) {
+      if (inst->operand[op].type == Operand_Memory &&
+          inst->operand[op].memory.type == EffectiveAddress_Direct) {
+        state.address = inst->operand[op].memory.displacement;
+      }
+    }
+
+    block->body_clocks += get_timing(inst, &state).min;
+  }
+
+  for (int32_t b = 0; b < cfg->count; ++b) {
+    block = &cfg->blocks[b];
+    block->taken_block = CFG_NO_BLOCK;
+    block->next_block = CFG_NO_BLOCK;
+    block->loop_last = CFG_NO_BLOCK;
+
+    if (block->ends_with_branch && cfg->labeled[block->target]) {
+      block->taken_block = cfg->block_at[block->target];
+    }
+
+    if ((!block->ends_with_branch || block->conditional) &&
+        block->end < used && block->end != 0) {
+      block->next_block = cfg->block_at[block->end];
+    }
+  }
+
+  /* back edge jumps to block at or before itself, closing loop there */
+  for (int32_t b = 0; b < cfg->count; ++b) {
+    int32_t header = cfg->blocks[b].taken_block;
+    if (header == CFG_NO_BLOCK || header > b) {
+      continue;
+    }
+
+    struct cfg_block *loop = &cfg->blocks[header];
+    if (!loop->is_loop_header) {
+      loop->is_loop_header = true;
+      cfg->loops++;
+    }
+
+    if (b > loop->loop_last) {
+      loop->loop_last = b;
+    }
+  }
+
+  free(leaders);
+  free(starts);
+  free(addresses);
+  free(decoded);
+
+  return cfg;
+}
+
+void cfg_free(struct cfg *cfg) {
+  free(cfg->blocks);
+  free(cfg);
+}
+
+void cfg_set_probabilities(struct cfg *cfg, bool use_profile) {
+  for (int32_t b = 0; b < cfg->count; ++b) {
+    struct cfg_block *block = &cfg->blocks[b];
+    if (!block->ends_with_branch) {
+      continue;
+    }
+
+    uint16_t branch_ip = block->branch_ip;
+    struct branch_site *site = &branch_sites[branch_ip];
+    uint32_t trips = cfg_trip_counts[branch_ip];
+
+    block->probability_known = true;
+
+    if (!block->conditional) {
+      block->taken_probability = 1.0;
+    } else if (use_profile && site->executions != 0) {
+      block->taken_probability = (double)site->taken / site->executions;
+    } else if (trips != 0) {
+      block->taken_probability = (double)(trips - 1) / trips;
+    } else {
+      /* backward branches are assumed to run their loop once */
+      bool backward = block->target <= branch_ip;
+      block->taken_probability = backward ? 0.0 : GUESSED_TAKEN_PROBABILITY;
+      block->probability_known = false;
+    }
+  }
+}
+
+/*
+Propagates frequencies through blocks head..last in address order, which
+orders forward edges topologically. Inner loop headers already know their
+cyclic probability, so their frequency is scaled by 1 / (1 - p) instead of
+following their back edges. Returns probability of getting back to head.
+*/
+double cfg_propagate(struct cfg *cfg, int32_t head, int32_t last,
+                     bool top_level, double *incoming) {
+  double back_to_head = 0.0;
+
+  for (int32_t b = head; b <= last; ++b) {
+    incoming[b] = 0.0;
+  }
+
+  for (int32_t b = head; b <= last; ++b) {
+    struct cfg_block *block = &cfg->blocks[b];
+    double frequency = b == head ? 1.0 : incoming[b];
+
+    if (block->is_loop_header && (b != head || top_level)) {
+      frequency /= 1.0 - block->cyclic_probability;
+    }
+
+    block->executions = frequency;
+
+    int32_t successors[2] = {block->taken_block, block->next_block};
+    double probabilities[2] = {block->taken_probability,
+                               1.0 - block->taken_probability};
+
+    if (!block->ends_with_branch) {
+      probabilities[0] = 0.0;
+      probabilities[1] = 1.0;
+    }
+
+    for (int i = 0; i < 2; ++i) {
+      int32_t successor = successors[i];
+      double flow = frequency * probabilities[i];
+
+      if (successor == CFG_NO_BLOCK || flow == 0.0) {
+        continue;
+      }
+
+      if (successor > b && successor <= last) {
+        incoming[successor] += flow;
+      } else if (successor == head && !top_level) {
+        back_to_head += flow;
+      }
+    }
+  }
+
+  return back_to_head;
+}
+
+struct cfg_block *sorted_blocks = NULL;
+
+int compare_loop_size(const void *a, const void *b) {
+  int32_t header_a = *(const int32_t *)a;
+  int32_t header_b = *(const int32_t *)b;
+  int32_t size_a = sorted_blocks[header_a].loop_last - header_a;
+  int32_t size_b = sorted_blocks[header_b].loop_last - header_b;
+  return (size_a > size_b) - (size_a < size_b);
+}
+
+double cfg_estimate(struct cfg *cfg, bool use_profile) {
+  if (cfg->count == 0) {
+    return 0.0;
+  }
+
+  cfg_set_probabilities(cfg, use_profile);
+
+  double *incoming = malloc(cfg->count * sizeof(*incoming));
+  int32_t *headers = malloc(cfg->count * sizeof(*headers));
+  uint32_t header_count = 0;
+
+  for (int32_t b = 0; b < cfg->count; ++b) {
+    if (cfg->blocks[b].is_loop_header) {
+      headers[header_count++] = b;
+    }
+  }
+
+  /* inner loops first, they span fewer blocks than loops around them */
+  sorted_blocks = cfg->blocks;
+  qsort(headers, header_count, sizeof(*headers), compare_loop_size);
+
+  for (uint32_t i = 0; i < header_count; ++i) {
+    struct cfg_block *header = &cfg->blocks[headers[i]];
+    double cyclic = cfg_propagate(cfg, headers[i], header->loop_last, false,
+                                  incoming);
+
+    header->cyclic_probability =
+        cyclic < MAX_CYCLIC_PROBABILITY ? cyclic : MAX_CYCLIC_PROBABILITY;
+  }
+
+  cfg_propagate(cfg, 0, cfg->count - 1, true, incoming);
+
+  double clocks = 0.0;
+  for (int32_t b = 0; b < cfg->count; ++b) {
+    struct cfg_block *block = &cfg->blocks[b];
+    double branch_clocks =
+        block->taken_probability * block->taken_clocks +
+        (1.0 - block->taken_probability) * block->not_taken_clocks;
+
+    clocks += block->executions *
+              (block->body_clocks + (block->ends_with_branch ? branch_clocks
+                                                             : 0.0));
+  }
+
+  free(headers);
+  free(incoming);
+
+  return clocks;
+}
+
+void cfg_print_report(struct cfg *cfg, double estimate,
+                      uint64_t executed_clocks) {
+  uint32_t guessed = 0;
+
+  printf("\nControl flow:\n");
+  printf("\tblocks: %d\n", cfg->count);
+  printf("\tinstructions: %u\n", cfg->instructions);
+  printf("\tloops: %u\n", cfg->loops);
+  printf("\tunresolved jumps: %u\n", cfg->unresolved);
+
+  printf("\n\t start    end  instrs   clocks  branch   taken  executions"
+         "  est. clocks\n");
+
+  for (int32_t b = 0; b < cfg->count; ++b) {
+    struct cfg_block *block = &cfg->blocks[b];
+    guessed += block->ends_with_branch && !block->probability_known;
+
+    if (b >= CFG_REPORT_LIMIT) {
+      continue;
+    }
+
+    double clocks =
+        block->executions *
+        (block->body_clocks +
+         (block->ends_with_branch
+              ? block->taken_probability * block->taken_clocks +
+                    (1.0 - block->taken_probability) * block->not_taken_clocks
+              : 0.0));
+
+    printf("\t0x%04x 0x%04x %7u %8u  ", block->start, block->end,
+           block->count, block->body_clocks);
+
+    if (block->ends_with_branch) {
+      struct instruction branch = {.type = block->branch};
+      printf("%-7s %5.1f%%%c", inst_get_name(&branch),
+             100.0 * block->taken_probability,
+             block->probability_known ? ' ' : '?');
+    } else {
+      printf("%-7s %7s", "", "");
+    }
+
+    printf(" %11.1f %12.0f\n", block->executions, clocks);
+  }
+
+  if (cfg->count > CFG_REPORT_LIMIT) {
+    printf("\t(%d more blocks)\n", cfg->count - CFG_REPORT_LIMIT);
+  }
+
+  printf("\nEstimate:\n");
+  printf("\ttotal clocks: %.0f\n", estimate);
+  printf("\tguessed branches: %u\n", guessed);
+
+  if (executed_clocks != 0) {
+    printf("\texecuted clocks: %llu (estimate off by %+.2f%%)\n",
+           (unsigned long long)executed_clocks,
+           100.0 * (estimate - executed_clocks) / executed_clocks);
+  }
+}
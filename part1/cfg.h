@@ -0,0 +1,81 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include "instruction.h"
+#include "memory.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CFG_NO_BLOCK (-1)
+
+struct sim86;
+
+/*
+Basic block found by static analysis. Successors are block indices, or
+CFG_NO_BLOCK when control leaves analysed code or lands inside an
+instruction.
+*/
+struct cfg_block {
+  uint16_t start;
+  uint16_t end; /* address right after the last instruction */
+  uint16_t count;
+  bool ends_with_branch;
+  bool conditional; /* terminating branch may fall through */
+  enum instruction_type branch;
+  uint16_t branch_ip;
+  uint16_t target;
+
+  int32_t taken_block;
+  int32_t next_block; /* fall through successor */
+
+  uint32_t body_clocks; /* every instruction except a terminating branch */
+  uint16_t taken_clocks;
+  uint16_t not_taken_clocks;
+
+  double taken_probability;
+  bool probability_known; /* from trip count or profile, not guessed */
+
+  /* loop closed by back edges to this block, last block of its body */
+  bool is_loop_header;
+  int32_t loop_last;
+  double cyclic_probability;
+
+  double executions; /* estimated */
+};
+
+struct cfg {
+  struct cfg_block *blocks;
+  int32_t count;
+  uint32_t instructions;
+  uint32_t loops;
+  uint32_t unresolved; /* jumps to addresses that start no instruction */
+
+  int32_t block_at[MEM_SIZE]; /* block starting at address */
+  bool labeled[MEM_SIZE];     /* address is target of a jump or call */
+};
+
+/*
+Iterations per loop entry of loops closed by branch at an address, set by
+--trips. Zero when unknown.
+*/
+extern uint32_t cfg_trip_counts[MEM_SIZE];
+
+/* Parses "IP:N[,IP:N...]" into cfg_trip_counts, false on malformed input. */
+bool cfg_parse_trip_counts(char *spec);
+
+/* Builds graph of code in sim memory between 0 and size. */
+struct cfg *cfg_build(struct sim86 *sim, uint16_t size);
+void cfg_free(struct cfg *cfg);
+
+/*
+Estimates executions of every block from branch probabilities and returns
+total clocks. Probabilities come from recorded branch statistics when
+use_profile is set, then from trip counts, otherwise they are guessed.
+*/
+double cfg_estimate(struct cfg *cfg, bool use_profile);
+
+/* Prints blocks and estimate, executed_clocks is 0 when nothing ran. */
+void cfg_print_report(struct cfg *cfg, double estimate,
+                      uint64_t executed_clocks);
+
+#endif // CFG_H
@@ -1,9 +1,12 @@
 #include "clocks.h"
 #include "instruction.h"
+#include "string_ops.h"
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
+struct bus_model bus_model = {CPU_8086, 0};
+
 uint16_t calc_ea(struct operand op) {
   switch (op.memory.type) {
   case EffectiveAddress_Direct:
@@ -34,8 +37,8 @@ uint16_t calc_ea(struct operand op) {
   }
 }
 
-void update_timing(struct instruction_timing *state, uint16_t base_min,
-                   uint16_t base_max, uint16_t ea) {
+void update_timing(struct instruction_timing *state, uint32_t base_min,
+                   uint32_t base_max, uint16_t ea) {
   state->base_min = base_min;
   state->base_max = base_max;
   state->ea = ea;
@@ -43,6 +46,174 @@ void update_timing(struct instruction_timing *state, uint16_t base_min,
   state->max = base_max + ea;
 }
 
+uint16_t memory_transfers(struct instruction *instruction) {
+  bool isDstMemory = instruction->operand[0].type == Operand_Memory;
+  bool isSrcMemory = instruction->operand[1].type == Operand_Memory;
+
+  switch (instruction->type) {
+  case INST_MOV:
+  case INST_CMP:
+  case INST_TEST:
+  case INST_PUSH:
+  case INST_POP:
+  case INST_CALL:
+  case INST_MUL:
+  case INST_IMUL:
+  case INST_DIV:
+  case INST_IDIV:
+    return isDstMemory || isSrcMemory;
+
+  case INST_ADD:
+  case INST_SUB:
+  case INST_ADC:
+  case INST_SBB:
+  case INST_AND:
+  case INST_OR:
+  case INST_XOR:
+  case INST_INC:
+  case INST_DEC:
+  case INST_NEG:
+  case INST_NOT:
+  case INST_ROL:
+  case INST_ROR:
+  case INST_RCL:
+  case INST_RCR:
+  case INST_SHL:
+  case INST_SHR:
+  case INST_SAR:
+    /* memory destination is read and written back */
+    return isDstMemory ? 2 : isSrcMemory;
+
+  case INST_MOVS:
+  case INST_CMPS:
+    return 2;
+
+  case INST_SCAS:
+  case INST_LODS:
+  case INST_STOS:
+    return 1;
+
+  /* port transfers go over the same bus, port in place of address */
+  case INST_IN:
+  case INST_OUT:
+    return 1;
+
+  default:
+    return 0;
+  }
+}
+
+uint16_t stack_transfers(struct instruction *instruction) {
+  switch (instruction->type) {
+  case INST_PUSH:
+  case INST_POP:
+  case INST_CALL:
+  case INST_RET:
+    return 1;
+
+  default:
+    return 0;
+  }
+}
+
+bool is_repeated(struct instruction *instruction) {
+  return is_string(instruction->type) &&
+         (instruction->prefixes & (PREFIX_REP | PREFIX_REPNE));
+}
+
+/* Bus cycles of one word transfer at address. */
+uint16_t word_cycles(struct bus_model *bus, uint16_t address) {
+  return bus->cpu == CPU_8088 || (address & 1) != 0 ? 2 : 1;
+}
+
+/* Bus cycles of one transfer at address. */
+uint16_t transfer_cycles(struct bus_model *bus,
+                         struct instruction *instruction, uint16_t address) {
+  return instruction->flags & F_W ? word_cycles(bus, address) : 1;
+}
+
+uint32_t bus_cycles(struct bus_model *bus, struct instruction *instruction,
+                    struct timing_state *state) {
+  if (!is_string(instruction->type)) {
+    /* stack is always accessed by words */
+    return memory_transfers(instruction) *
+               transfer_cycles(bus, instruction, state->address) +
+           stack_transfers(instruction) * word_cycles(bus, state->stack);
+  }
+
+  /* SI and DI keep their parity, so every iteration costs the same */
+  enum instruction_type type = instruction->type;
+  bool reads_source = type == INST_MOVS || type == INST_CMPS ||
+                      type == INST_LODS;
+  bool uses_destination = type != INST_LODS;
+
+  uint32_t cycles =
+      reads_source * transfer_cycles(bus, instruction, state->address) +
+      uses_destination * transfer_cycles(bus, instruction, state->destination);
+
+  return is_repeated(instruction) ? cycles * state->repetitions : cycles;
+}
+
+uint32_t bus_penalty(struct bus_model *bus, struct instruction *instruction,
+                     struct timing_state *state) {
+  uint32_t transfers =
+      memory_transfers(instruction) + stack_transfers(instruction);
+  if (is_repeated(instruction)) {
+    transfers *= state->repetitions;
+  }
+
+  if (transfers == 0) {
+    return 0;
+  }
+
+  uint32_t cycles = bus_cycles(bus, instruction, state);
+  return (cycles - transfers) * 4 + cycles * bus->wait_states;
+}
+
+struct clock_range {
+  uint16_t min;
+  uint16_t max;
+};
+
+/*
+Table range of MUL, IMUL, DIV and IDIV, memory source adds 6 clocks. Where
+in the range an operand lands depends on the microcode loop, which is not
+modeled, so the range is kept even when operands are known.
+*/
+struct clock_range multiply_divide_clocks(struct instruction *instruction,
+                                          bool memory) {
+  static const struct clock_range table[4][2] = {
+      {{70, 77}, {118, 133}},   /* MUL */
+      {{80, 98}, {128, 154}},   /* IMUL */
+      {{80, 90}, {144, 162}},   /* DIV */
+      {{101, 112}, {165, 184}}, /* IDIV */
+  };
+
+  bool wide = instruction->flags & F_W;
+  struct clock_range range = table[instruction->type - INST_MUL][wide];
+
+  if (memory) {
+    range.min += 6;
+    range.max += 6;
+  }
+
+  return range;
+}
+
+/* Clocks of one execution, or of CX iterations with a repeat prefix. */
+uint32_t string_clocks(struct instruction *instruction,
+                       uint32_t repetitions) {
+  static const uint16_t single[] = {18, 22, 15, 12, 11};
+  static const uint16_t per_repetition[] = {17, 22, 15, 13, 10};
+  uint8_t index = instruction->type - INST_MOVS;
+
+  if (!is_repeated(instruction)) {
+    return single[index];
+  }
+
+  return 9 + per_repetition[index] * repetitions;
+}
+
 struct instruction_timing get_timing(struct instruction *instruction,
                                      struct timing_state *state) {
   struct instruction_timing result = {0};
@@ -86,7 +257,12 @@ struct instruction_timing get_timing(struct instruction *instruction,
   } break;
 
   case INST_ADD:
-  case INST_SUB: {
+  case INST_SUB:
+  case INST_ADC:
+  case INST_SBB:
+  case INST_AND:
+  case INST_OR:
+  case INST_XOR: {
     if (isDstRegister && isSrcRegister) {
       update_timing(&result, 3, 3, ea);
     }
@@ -130,14 +306,174 @@ struct instruction_timing get_timing(struct instruction *instruction,
     }
   } break;
 
-  case INST_JNZ: {
+  case INST_TEST: {
+    if (isDstRegister && isSrcRegister) {
+      update_timing(&result, 3, 3, ea);
+    }
+
+    if (isDstMemory && isSrcRegister) {
+      update_timing(&result, 9, 9, ea);
+    }
+
+    /* accumulator form is one clock faster */
+    if (isDstRegister && isSrcImmediate) {
+      bool accumulator =
+          instruction->opcode == 0xA8 || instruction->opcode == 0xA9;
+      uint16_t v = accumulator ? 4 : 5;
+      update_timing(&result, v, v, ea);
+    }
+
+    if (isDstMemory && isSrcImmediate) {
+      update_timing(&result, 11, 11, ea);
+    }
+  } break;
+
+  case INST_INC:
+  case INST_DEC: {
+    uint16_t v = isDstMemory ? 15 : (instruction->flags & F_W) ? 2 : 3;
+    update_timing(&result, v, v, ea);
+  } break;
+
+  case INST_NEG:
+  case INST_NOT: {
+    uint16_t v = isDstMemory ? 16 : 3;
+    update_timing(&result, v, v, ea);
+  } break;
+
+  case INST_MUL:
+  case INST_IMUL:
+  case INST_DIV:
+  case INST_IDIV: {
+    struct clock_range range =
+        multiply_divide_clocks(instruction, isDstMemory);
+    update_timing(&result, range.min, range.max, ea);
+  } break;
+
+  case INST_ROL:
+  case INST_ROR:
+  case INST_RCL:
+  case INST_RCR:
+  case INST_SHL:
+  case INST_SHR:
+  case INST_SAR: {
+    if (!(instruction->flags & F_V)) {
+      uint16_t v = isDstMemory ? 15 : 2;
+      update_timing(&result, v, v, ea);
+      break;
+    }
+
+    /* 4 clocks per bit, count is any value of CL */
+    uint32_t v = isDstMemory ? 20 : 8;
+    if (state->operand_known) {
+      v += 4 * state->operand;
+      update_timing(&result, v, v, ea);
+    } else {
+      update_timing(&result, v, v + 4 * 255, ea);
+    }
+  } break;
+
+  case INST_JO:
+  case INST_JNO:
+  case INST_JB:
+  case INST_JAE:
+  case INST_JZ:
+  case INST_JNZ:
+  case INST_JBE:
+  case INST_JA:
+  case INST_JS:
+  case INST_JNS:
+  case INST_JP:
+  case INST_JPO:
+  case INST_JL:
+  case INST_JGE:
+  case INST_JLE:
+  case INST_JG: {
     uint16_t v = state->jumpTaken ? 16 : 4;
     update_timing(&result, v, v, ea);
   } break;
 
+  case INST_JMP: {
+    update_timing(&result, 15, 15, ea);
+  } break;
+
+  case INST_LOOP: {
+    uint16_t v = state->jumpTaken ? 17 : 5;
+    update_timing(&result, v, v, ea);
+  } break;
+
+  case INST_LOOPZ:
+  case INST_JCXZ: {
+    uint16_t v = state->jumpTaken ? 18 : 6;
+    update_timing(&result, v, v, ea);
+  } break;
+
+  case INST_LOOPNZ: {
+    uint16_t v = state->jumpTaken ? 19 : 5;
+    update_timing(&result, v, v, ea);
+  } break;
+
+  case INST_PUSH: {
+    bool segment = isDstRegister && op_dst.register_.type >= Reg_ES;
+    uint16_t v = isDstMemory ? 16 : segment ? 10 : 11;
+    update_timing(&result, v, v, ea);
+  } break;
+
+  case INST_POP: {
+    uint16_t v = isDstMemory ? 17 : 8;
+    update_timing(&result, v, v, ea);
+  } break;
+
+  case INST_CALL: {
+    /* direct, through register or through memory */
+    uint16_t v = isDstMemory ? 21 : isDstRegister ? 16 : 19;
+    update_timing(&result, v, v, ea);
+  } break;
+
+  case INST_RET: {
+    /* form with immediate also releases arguments */
+    uint16_t v = op_dst.type == Operand_Immediate ? 12 : 8;
+    update_timing(&result, v, v, ea);
+  } break;
+
+  case INST_IN:
+  case INST_OUT: {
+    /* fixed port form is two clocks slower than port in DX */
+    bool fixed = op_dst.type == Operand_Immediate ||
+                 op_src.type == Operand_Immediate;
+    uint16_t v = fixed ? 10 : 8;
+    update_timing(&result, v, v, ea);
+  } break;
+
+  case INST_MOVS:
+  case INST_CMPS:
+  case INST_SCAS:
+  case INST_LODS:
+  case INST_STOS: {
+    uint32_t v = string_clocks(instruction, state->repetitions);
+    update_timing(&result, v, v, ea);
+  } break;
+
+  case INST_CLD:
+  case INST_STD: {
+    update_timing(&result, 2, 2, ea);
+  } break;
+
   default:
     break;
   }
 
+  /* segment override and LOCK take two clocks each, REP is in base above */
+  uint8_t prefixes = instruction->prefixes;
+  uint16_t prefix_clocks = ((prefixes & PREFIX_SEGMENT) ? 2 : 0) +
+                           ((prefixes & PREFIX_LOCK) ? 2 : 0);
+  if (prefix_clocks != 0 && result.max != 0) {
+    update_timing(&result, result.base_min + prefix_clocks,
+                  result.base_max + prefix_clocks, ea);
+  }
+
+  result.penalty = bus_penalty(&bus_model, instruction, state);
+  result.min += result.penalty;
+  result.max += result.penalty;
+
   return result;
 }
@@ -5,18 +5,62 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+enum cpu_model : uint8_t {
+  CPU_8086, /* 16-bit bus, word transfers at odd addresses take two cycles */
+  CPU_8088, /* 8-bit bus, every word transfer takes two cycles */
+};
+
+struct bus_model {
+  enum cpu_model cpu;
+  uint16_t wait_states; /* extra clocks added to every bus cycle */
+};
+
+/* bus total_clocks are counted on */
+extern struct bus_model bus_model;
+
+/* wide enough for a repeated string instruction over whole memory */
 struct instruction_timing {
-  uint16_t base_min;
-  uint16_t base_max;
+  uint32_t base_min;
+  uint32_t base_max;
   uint16_t ea;
-  uint16_t min;
-  uint16_t max;
+  uint32_t penalty; /* bus penalty of memory transfers */
+  uint32_t min;
+  uint32_t max;
 };
 
 struct timing_state {
   bool jumpTaken;
+  uint16_t address;     /* effective address of memory operand, SI or port */
+  uint16_t destination; /* DI of string instructions */
+  uint16_t stack;       /* SP of word pushed or popped */
+  uint32_t repetitions; /* iterations of a repeated string instruction */
+
+  /* shift count, once the instruction has run */
+  bool operand_known;
+  uint16_t operand;
 };
 
+/*
+Number of memory transfers made by instruction operands, per iteration for
+string instructions. IN and OUT count their port transfer.
+*/
+uint16_t memory_transfers(struct instruction *instruction);
+
+/* Words PUSH, POP, CALL and RET move to or from stack. */
+uint16_t stack_transfers(struct instruction *instruction);
+
+/* Bus cycles of memory transfers, words take two on 8088 or odd address. */
+uint32_t bus_cycles(struct bus_model *bus, struct instruction *instruction,
+                    struct timing_state *state);
+
+/* Clocks added by the bus model to memory transfers. */
+uint32_t bus_penalty(struct bus_model *bus, struct instruction *instruction,
+                     struct timing_state *state);
+
+/*
+Table clocks of instruction plus bus penalty on bus_model. Everything but
+the penalty is the same on every bus.
+*/
 struct instruction_timing get_timing(struct instruction *,
                                      struct timing_state *);
 
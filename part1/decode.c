@@ -1,8 +1,10 @@
 #include "decode.h"
 #include "instruction.h"
 #include "memory.h"
+#include "sim86.h"
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #define MOD(bits) (0b##bits << 6)
 #define REG(bits) (0b##bits << 3)
@@ -10,6 +12,17 @@
 #define XXX(bits) (0b##bits << 3)
 #define SR(bits) (0b##bits << 3)
 
+/* instruction types of extended opcodes, indexed by reg field */
+#define IMMEDIATE_GROUP                                                        \
+  {INST_ADD, INST_OR, INST_ADC, INST_SBB, INST_AND, INST_SUB, INST_XOR,       \
+   INST_CMP}
+#define UNARY_GROUP                                                            \
+  {INST_TEST, INST_NOT_USED, INST_NOT, INST_NEG, INST_MUL, INST_IMUL,         \
+   INST_DIV, INST_IDIV}
+#define SHIFT_GROUP                                                            \
+  {INST_ROL, INST_ROR, INST_RCL, INST_RCR, INST_SHL, INST_SHR,                \
+   INST_NOT_USED, INST_SAR}
+
 // clang-format off
 struct instruction_encoding instructions[256] = {
     // MOV - RM to/from REG
@@ -49,13 +62,13 @@ struct instruction_encoding instructions[256] = {
     [0xA3] = {NOT_EXTENDED, INST_MOV, BYTE, F_W | REG | RM, REG(000) | RM(110)},
 
     // MOV - RM to SR
-    [0x8E] = {NOT_EXTENDED, INST_MOV, WORD, F_D | MOD | SR | RM},
+    [0x8E] = {NOT_EXTENDED, INST_MOV, WORD, F_D | F_W | MOD | SR | RM},
 
     // MOV - SR to RM
-    [0x8C] = {NOT_EXTENDED, INST_MOV, WORD, MOD | SR | RM},
+    [0x8C] = {NOT_EXTENDED, INST_MOV, WORD, F_W | MOD | SR | RM},
 
-    // PUSH - RM
-    [0xFF] = {EXTENDED, .types = {[0x6] = INST_PUSH}, WORD, F_W | MOD | RM},
+    // INC, DEC, CALL, PUSH - RM
+    [0xFF] = {EXTENDED, .types = {INST_INC, INST_DEC, INST_CALL, [0x6] = INST_PUSH}, WORD, F_W | MOD | RM},
 
     // PUSH - REG
     [0x50] = {NOT_EXTENDED, INST_PUSH, BYTE, F_D | F_W | REG, REG(000)},
@@ -128,19 +141,11 @@ struct instruction_encoding instructions[256] = {
     [0x02] = {NOT_EXTENDED, INST_ADD, WORD, F_D | MOD | REG | RM},
     [0x03] = {NOT_EXTENDED, INST_ADD, WORD, F_W | F_D | MOD | REG | RM},
 
-    // ADD, SUB, CMP - IMM to RM
-    [0x80] = {EXTENDED,
-              .types = {INST_ADD, [0x5] = INST_SUB, [0x7] = INST_CMP},
-              WORD, MOD | RM | DATA},
-    [0x81] = {EXTENDED,
-              .types = {INST_ADD, [0x5] = INST_SUB, [0x7] = INST_CMP},
-              WORD, F_W | MOD | RM | DATA},
-    [0x82] = {EXTENDED,
-              .types = {INST_ADD, [0x5] = INST_SUB, [0x7] = INST_CMP},
-              WORD, F_S | MOD | RM | DATA},
-    [0x83] = {EXTENDED,
-              .types = {INST_ADD, [0x5] = INST_SUB, [0x7] = INST_CMP},
-              WORD, F_W | F_S | MOD | RM | DATA},
+    // ADD, OR, ADC, SBB, AND, SUB, XOR, CMP - IMM to RM
+    [0x80] = {EXTENDED, .types = IMMEDIATE_GROUP, WORD, MOD | RM | DATA},
+    [0x81] = {EXTENDED, .types = IMMEDIATE_GROUP, WORD, F_W | MOD | RM | DATA},
+    [0x82] = {EXTENDED, .types = IMMEDIATE_GROUP, WORD, F_S | MOD | RM | DATA},
+    [0x83] = {EXTENDED, .types = IMMEDIATE_GROUP, WORD, F_W | F_S | MOD | RM | DATA},
 
     // ADD - IMM to ACC
     [0x04] = {NOT_EXTENDED, INST_ADD, BYTE, F_D | REG | DATA, REG(000)},
@@ -166,6 +171,97 @@ struct instruction_encoding instructions[256] = {
     [0x3C] = {NOT_EXTENDED, INST_CMP, BYTE, F_D | REG | DATA, REG(000)},
     [0x3D] = {NOT_EXTENDED, INST_CMP, BYTE, F_D | F_W | REG | DATA, REG(000)},
 
+    // ADC - RM with REG to either
+    [0x10] = {NOT_EXTENDED, INST_ADC, WORD, MOD | REG | RM},
+    [0x11] = {NOT_EXTENDED, INST_ADC, WORD, F_W | MOD | REG | RM},
+    [0x12] = {NOT_EXTENDED, INST_ADC, WORD, F_D | MOD | REG | RM},
+    [0x13] = {NOT_EXTENDED, INST_ADC, WORD, F_W | F_D | MOD | REG | RM},
+
+    // ADC - IMM to ACC
+    [0x14] = {NOT_EXTENDED, INST_ADC, BYTE, F_D | REG | DATA, REG(000)},
+    [0x15] = {NOT_EXTENDED, INST_ADC, BYTE, F_D | F_W | REG | DATA, REG(000)},
+
+    // SBB - RM with REG to either
+    [0x18] = {NOT_EXTENDED, INST_SBB, WORD, MOD | REG | RM},
+    [0x19] = {NOT_EXTENDED, INST_SBB, WORD, F_W | MOD | REG | RM},
+    [0x1A] = {NOT_EXTENDED, INST_SBB, WORD, F_D | MOD | REG | RM},
+    [0x1B] = {NOT_EXTENDED, INST_SBB, WORD, F_W | F_D | MOD | REG | RM},
+
+    // SBB - IMM to ACC
+    [0x1C] = {NOT_EXTENDED, INST_SBB, BYTE, F_D | REG | DATA, REG(000)},
+    [0x1D] = {NOT_EXTENDED, INST_SBB, BYTE, F_D | F_W | REG | DATA, REG(000)},
+
+    // AND - RM with REG to either
+    [0x20] = {NOT_EXTENDED, INST_AND, WORD, MOD | REG | RM},
+    [0x21] = {NOT_EXTENDED, INST_AND, WORD, F_W | MOD | REG | RM},
+    [0x22] = {NOT_EXTENDED, INST_AND, WORD, F_D | MOD | REG | RM},
+    [0x23] = {NOT_EXTENDED, INST_AND, WORD, F_W | F_D | MOD | REG | RM},
+
+    // AND - IMM to ACC
+    [0x24] = {NOT_EXTENDED, INST_AND, BYTE, F_D | REG | DATA, REG(000)},
+    [0x25] = {NOT_EXTENDED, INST_AND, BYTE, F_D | F_W | REG | DATA, REG(000)},
+
+    // OR - RM with REG to either
+    [0x08] = {NOT_EXTENDED, INST_OR, WORD, MOD | REG | RM},
+    [0x09] = {NOT_EXTENDED, INST_OR, WORD, F_W | MOD | REG | RM},
+    [0x0A] = {NOT_EXTENDED, INST_OR, WORD, F_D | MOD | REG | RM},
+    [0x0B] = {NOT_EXTENDED, INST_OR, WORD, F_W | F_D | MOD | REG | RM},
+
+    // OR - IMM to ACC
+    [0x0C] = {NOT_EXTENDED, INST_OR, BYTE, F_D | REG | DATA, REG(000)},
+    [0x0D] = {NOT_EXTENDED, INST_OR, BYTE, F_D | F_W | REG | DATA, REG(000)},
+
+    // XOR - RM with REG to either
+    [0x30] = {NOT_EXTENDED, INST_XOR, WORD, MOD | REG | RM},
+    [0x31] = {NOT_EXTENDED, INST_XOR, WORD, F_W | MOD | REG | RM},
+    [0x32] = {NOT_EXTENDED, INST_XOR, WORD, F_D | MOD | REG | RM},
+    [0x33] = {NOT_EXTENDED, INST_XOR, WORD, F_W | F_D | MOD | REG | RM},
+
+    // XOR - IMM to ACC
+    [0x34] = {NOT_EXTENDED, INST_XOR, BYTE, F_D | REG | DATA, REG(000)},
+    [0x35] = {NOT_EXTENDED, INST_XOR, BYTE, F_D | F_W | REG | DATA, REG(000)},
+
+    // TEST - RM with REG
+    [0x84] = {NOT_EXTENDED, INST_TEST, WORD, MOD | REG | RM},
+    [0x85] = {NOT_EXTENDED, INST_TEST, WORD, F_W | MOD | REG | RM},
+
+    // TEST - IMM to ACC
+    [0xA8] = {NOT_EXTENDED, INST_TEST, BYTE, F_D | REG | DATA, REG(000)},
+    [0xA9] = {NOT_EXTENDED, INST_TEST, BYTE, F_D | F_W | REG | DATA, REG(000)},
+
+    // TEST, NOT, NEG, MUL, IMUL, DIV, IDIV - RM, only TEST takes IMM
+    [0xF6] = {EXTENDED, .types = UNARY_GROUP, WORD, MOD | RM | DATA | EXT0_DATA},
+    [0xF7] = {EXTENDED, .types = UNARY_GROUP, WORD, F_W | MOD | RM | DATA | EXT0_DATA},
+
+    // INC, DEC - RM
+    [0xFE] = {EXTENDED, .types = {INST_INC, INST_DEC}, WORD, MOD | RM},
+
+    // INC - REG
+    [0x40] = {NOT_EXTENDED, INST_INC, BYTE, F_D | F_W | REG, REG(000)},
+    [0x41] = {NOT_EXTENDED, INST_INC, BYTE, F_D | F_W | REG, REG(001)},
+    [0x42] = {NOT_EXTENDED, INST_INC, BYTE, F_D | F_W | REG, REG(010)},
+    [0x43] = {NOT_EXTENDED, INST_INC, BYTE, F_D | F_W | REG, REG(011)},
+    [0x44] = {NOT_EXTENDED, INST_INC, BYTE, F_D | F_W | REG, REG(100)},
+    [0x45] = {NOT_EXTENDED, INST_INC, BYTE, F_D | F_W | REG, REG(101)},
+    [0x46] = {NOT_EXTENDED, INST_INC, BYTE, F_D | F_W | REG, REG(110)},
+    [0x47] = {NOT_EXTENDED, INST_INC, BYTE, F_D | F_W | REG, REG(111)},
+
+    // DEC - REG
+    [0x48] = {NOT_EXTENDED, INST_DEC, BYTE, F_D | F_W | REG, REG(000)},
+    [0x49] = {NOT_EXTENDED, INST_DEC, BYTE, F_D | F_W | REG, REG(001)},
+    [0x4A] = {NOT_EXTENDED, INST_DEC, BYTE, F_D | F_W | REG, REG(010)},
+    [0x4B] = {NOT_EXTENDED, INST_DEC, BYTE, F_D | F_W | REG, REG(011)},
+    [0x4C] = {NOT_EXTENDED, INST_DEC, BYTE, F_D | F_W | REG, REG(100)},
+    [0x4D] = {NOT_EXTENDED, INST_DEC, BYTE, F_D | F_W | REG, REG(101)},
+    [0x4E] = {NOT_EXTENDED, INST_DEC, BYTE, F_D | F_W | REG, REG(110)},
+    [0x4F] = {NOT_EXTENDED, INST_DEC, BYTE, F_D | F_W | REG, REG(111)},
+
+    // ROL, ROR, RCL, RCR, SHL, SHR, SAR - RM by 1 or by CL
+    [0xD0] = {EXTENDED, .types = SHIFT_GROUP, WORD, MOD | RM | COUNT},
+    [0xD1] = {EXTENDED, .types = SHIFT_GROUP, WORD, F_W | MOD | RM | COUNT},
+    [0xD2] = {EXTENDED, .types = SHIFT_GROUP, WORD, F_V | MOD | RM | COUNT},
+    [0xD3] = {EXTENDED, .types = SHIFT_GROUP, WORD, F_V | F_W | MOD | RM | COUNT},
+
     // JMP / LOOP
     [0x70] = {NOT_EXTENDED, INST_JO, BYTE, ADDR},
     [0x71] = {NOT_EXTENDED, INST_JNO, BYTE, ADDR},
@@ -183,10 +279,32 @@ struct instruction_encoding instructions[256] = {
     [0x7D] = {NOT_EXTENDED, INST_JGE, BYTE, ADDR},
     [0x7E] = {NOT_EXTENDED, INST_JLE, BYTE, ADDR},
     [0x7F] = {NOT_EXTENDED, INST_JG, BYTE, ADDR},
+    [0xEB] = {NOT_EXTENDED, INST_JMP, BYTE, ADDR},
     [0xE0] = {NOT_EXTENDED, INST_LOOPNZ, BYTE, ADDR},
     [0xE1] = {NOT_EXTENDED, INST_LOOPZ, BYTE, ADDR},
     [0xE2] = {NOT_EXTENDED, INST_LOOP, BYTE, ADDR},
     [0xE3] = {NOT_EXTENDED, INST_JCXZ, BYTE, ADDR},
+
+    // CALL / RET - near, within segment
+    [0xE8] = {NOT_EXTENDED, INST_CALL, BYTE, ADDR16},
+    [0xC3] = {NOT_EXTENDED, INST_RET, BYTE},
+    [0xC2] = {NOT_EXTENDED, INST_RET, BYTE, F_W | DATA},
+
+    // String manipulation, operands are implied by SI, DI, CX and AL/AX
+    [0xA4] = {NOT_EXTENDED, INST_MOVS, BYTE},
+    [0xA5] = {NOT_EXTENDED, INST_MOVS, BYTE, F_W},
+    [0xA6] = {NOT_EXTENDED, INST_CMPS, BYTE},
+    [0xA7] = {NOT_EXTENDED, INST_CMPS, BYTE, F_W},
+    [0xAA] = {NOT_EXTENDED, INST_STOS, BYTE},
+    [0xAB] = {NOT_EXTENDED, INST_STOS, BYTE, F_W},
+    [0xAC] = {NOT_EXTENDED, INST_LODS, BYTE},
+    [0xAD] = {NOT_EXTENDED, INST_LODS, BYTE, F_W},
+    [0xAE] = {NOT_EXTENDED, INST_SCAS, BYTE},
+    [0xAF] = {NOT_EXTENDED, INST_SCAS, BYTE, F_W},
+
+    // Processor control
+    [0xFC] = {NOT_EXTENDED, INST_CLD, BYTE},
+    [0xFD] = {NOT_EXTENDED, INST_STD, BYTE},
 };
 // clang-format on
 
@@ -195,9 +313,12 @@ struct instruction_encoding instructions[256] = {
 #undef RM
 #undef XXX
 #undef SR
+#undef IMMEDIATE_GROUP
+#undef UNARY_GROUP
+#undef SHIFT_GROUP
 
 struct operand get_register_operand(uint8_t reg_index, uint8_t wide) {
-  struct register_access reg_table[] = {
+  static const struct register_access reg_table[] = {
       {Reg_A, RegByte_Low},  {Reg_C, RegByte_Low},
       {Reg_D, RegByte_Low},  {Reg_B, RegByte_Low},
 
@@ -218,7 +339,7 @@ struct operand get_register_operand(uint8_t reg_index, uint8_t wide) {
 }
 
 struct operand get_segment_register_operand(uint8_t sr_index) {
-  struct register_access sr_table[] = {
+  static const struct register_access sr_table[] = {
       {Reg_ES, RegByte_All},
       {Reg_CS, RegByte_All},
       {Reg_SS, RegByte_All},
@@ -236,7 +357,7 @@ enum effective_address_type get_effective_address_type(uint8_t index,
     return EffectiveAddress_Direct;
   }
 
-  enum effective_address_type ea_table[] = {
+  static const enum effective_address_type ea_table[] = {
       EffectiveAddress_BX_SI, EffectiveAddress_BX_DI,
       EffectiveAddress_BP_SI, EffectiveAddress_BP_DI,
 
@@ -247,26 +368,42 @@ enum effective_address_type get_effective_address_type(uint8_t index,
   return ea_table[index];
 }
 
-bool decode_instruction(uint8_t ip, struct instruction *inst) {
-  uint8_t buf[2];
-  uint8_t ipo = ip; /* instruction pointer with offset */
+void decode_bytes(const uint8_t *code, struct instruction *inst) {
+  const uint8_t *p = code; /* next byte to decode */
+
+  for (uint8_t count = 0; count < MAX_PREFIXES; ++count) {
+    if (*p == 0xF0) {
+      inst->prefixes |= PREFIX_LOCK;
+    } else if (*p == 0xF3) {
+      inst->prefixes = (inst->prefixes & ~PREFIX_REPNE) | PREFIX_REP;
+    } else if (*p == 0xF2) {
+      inst->prefixes = (inst->prefixes & ~PREFIX_REP) | PREFIX_REPNE;
+    } else if ((*p & 0xE7) == 0x26) {
+      /* 26, 2E, 36, 3E select ES, CS, SS, DS */
+      inst->prefixes |= PREFIX_SEGMENT;
+      inst->segment = Reg_ES + ((*p >> 3) & 0x3);
+    } else {
+      break;
+    }
 
-  if ((mem_readn(ipo, buf, 1)) <= 0) {
-    return false;
+    p++;
   }
-  ipo += 1;
 
-  inst->bsize = 1;
-  struct instruction_encoding inst_encoding = instructions[buf[0]];
+  inst->opcode = *p++;
+  struct instruction_encoding inst_encoding = instructions[inst->opcode];
 
+  uint8_t modrm = 0;
   if (inst_encoding.size == WORD) {
-    ipo += mem_readn(ipo, buf, 1);
-    inst->bsize++;
+    modrm = *p++;
   }
 
   if (inst_encoding.extended == EXTENDED) {
-    uint8_t ext_bits = (buf[0] >> 3) & 0x7;
+    uint8_t ext_bits = (modrm >> 3) & 0x7;
     inst->type = inst_encoding.types[ext_bits];
+
+    if ((inst_encoding.fields & EXT0_DATA) && ext_bits != 0) {
+      inst_encoding.fields &= ~DATA;
+    }
   } else {
     inst->type = inst_encoding.type;
   }
@@ -279,7 +416,7 @@ bool decode_instruction(uint8_t ip, struct instruction *inst) {
   uint8_t rm_is_w = (inst_encoding.fields & RM_ALWAYS_W) || W;
 
   uint8_t fields =
-      (inst_encoding.size & BYTE) ? inst_encoding.included_fields : buf[0];
+      (inst_encoding.size & BYTE) ? inst_encoding.included_fields : modrm;
 
   struct operand *reg_op = &inst->operand[D ? 0 : 1];
   struct operand *rm_op = &inst->operand[D ? 1 : 0];
@@ -308,18 +445,25 @@ bool decode_instruction(uint8_t ip, struct instruction *inst) {
       uint8_t is_direct_address = rm_op->memory.type == EffectiveAddress_Direct;
 
       if (mod == MOD_MEM8) {
-        ipo += mem_readn(ipo, buf, 1);
-        inst->bsize++;
-        rm_op->memory.displacement = (int8_t)buf[0];
+        rm_op->memory.displacement = (int8_t)p[0];
+        p += 1;
 
       } else if (mod == MOD_MEM16 || is_direct_address) {
-        ipo += mem_readn(ipo, buf, 2);
-        inst->bsize += 2;
-        rm_op->memory.displacement = (buf[1] << 8) | buf[0];
+        rm_op->memory.displacement = (p[1] << 8) | p[0];
+        p += 2;
       }
     }
   }
 
+  if (inst_encoding.fields & COUNT) {
+    if (inst_encoding.fields & F_V) {
+      inst->operand[1] = get_register_operand(0b001, 0); /* CL */
+    } else {
+      inst->operand[1].type = Operand_Immediate;
+      inst->operand[1].immediate = 1;
+    }
+  }
+
   struct operand *imm_op = &inst->operand[0];
   if (imm_op->type) {
     imm_op = &inst->operand[1];
@@ -330,30 +474,85 @@ bool decode_instruction(uint8_t ip, struct instruction *inst) {
                         !(inst_encoding.fields & F_S);
 
   if (is_imm_wide) {
-    ipo += mem_readn(ipo, buf, 2);
-    inst->bsize += 2;
     imm_op->type = Operand_Immediate;
-    imm_op->immediate = (buf[1] << 8) | buf[0];
+    imm_op->immediate = (p[1] << 8) | p[0];
+    p += 2;
 
   } else if (inst_encoding.fields & (DATA | DATA8)) {
-    ipo += mem_readn(ipo, buf, 1);
-    inst->bsize++;
     imm_op->type = Operand_Immediate;
 
     if (inst_encoding.fields & DATA) {
-      imm_op->immediate = (int8_t)buf[0];
+      imm_op->immediate = (int8_t)p[0];
 
     } else if (inst_encoding.fields & DATA8) {
-      imm_op->immediate = (uint8_t)buf[0];
+      imm_op->immediate = (uint8_t)p[0];
     }
+
+    p += 1;
   }
 
   if (inst_encoding.fields & ADDR) {
-    ipo += mem_readn(ipo, buf, 1);
-    inst->bsize++;
     imm_op->type = Operand_RelativeImmediate;
-    imm_op->immediate = (int8_t)buf[0];
+    imm_op->immediate = (int8_t)p[0];
+    p += 1;
+  }
+
+  if (inst_encoding.fields & ADDR16) {
+    imm_op->type = Operand_RelativeImmediate;
+    imm_op->immediate = (p[1] << 8) | p[0];
+    p += 2;
+  }
+
+  inst->bsize = p - code;
+}
+
+bool decode_instruction(struct sim86 *sim, uint16_t ip,
+                        struct instruction *inst) {
+  if (ip + MAX_INSTRUCTION_SIZE <= MEM_SIZE) {
+    decode_bytes(sim->memory + ip, inst);
+    return true;
   }
 
+  /* instruction may run past end of memory, missing bytes read as zero */
+  uint8_t buf[MAX_INSTRUCTION_SIZE] = {0};
+  if (mem_readn(sim, ip, buf, MAX_INSTRUCTION_SIZE) <= 0) {
+    return false;
+  }
+
+  decode_bytes(buf, inst);
   return true;
 }
+
+size_t decode_range(const uint8_t *code, size_t size, struct instruction *out,
+                    size_t capacity, size_t *size_used) {
+  size_t offset = 0;
+  size_t count = 0;
+
+  /* no bounds checks while a whole instruction is guaranteed to fit */
+  while (count < capacity && offset + MAX_INSTRUCTION_SIZE <= size) {
+    struct instruction *inst = &out[count++];
+    *inst = (struct instruction){0};
+    decode_bytes(code + offset, inst);
+    offset += inst->bsize;
+  }
+
+  while (count < capacity && offset < size) {
+    uint8_t buf[MAX_INSTRUCTION_SIZE] = {0};
+    memcpy(buf, code + offset, size - offset);
+
+    struct instruction inst = {0};
+    decode_bytes(buf, &inst);
+    if (offset + inst.bsize > size) {
+      break;
+    }
+
+    out[count++] = inst;
+    offset += inst.bsize;
+  }
+
+  if (size_used != NULL) {
+    *size_used = offset;
+  }
+
+  return count;
+}
@@ -2,6 +2,8 @@
 #define DECODE_H
 
 #include "instruction.h"
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define MOD_MEM 0b00
@@ -31,4 +33,25 @@ struct instruction_encoding {
   uint8_t included_fields;
 };
 
+extern struct instruction_encoding instructions[256];
+
+struct sim86;
+
+/*
+Decodes instruction at start of code, which must hold MAX_INSTRUCTION_SIZE
+readable bytes. Operands of inst must be cleared by caller.
+*/
+void decode_bytes(const uint8_t *code, struct instruction *inst);
+
+bool decode_instruction(struct sim86 *sim, uint16_t ip,
+                        struct instruction *inst);
+
+/*
+Decodes consecutive instructions of code into out, stopping at capacity or
+when next instruction does not fit in size. Returns decoded count and, when
+size_used is not NULL, number of bytes they take.
+*/
+size_t decode_range(const uint8_t *code, size_t size, struct instruction *out,
+                    size_t capacity, size_t *size_used);
+
 #endif
@@ -0,0 +1,161 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decode.h"
+#include "generate.h"
+#include "memory.h"
+#include "sim86.h"
+#include "timer.h"
+
+/*
+Measures decoder throughput over a large synthetic instruction stream:
+one instruction at a time through sim memory, and in bulk with
+decode_range(). Copy speed of same stream is reported as bandwidth bound.
+Makefile always builds it with -O2, unoptimized timings say little.
+*/
+
+#define RANGE_CHUNK 4096
+
+uint64_t bench_single(struct sim86 *sim, uint8_t *stream, size_t size) {
+  uint64_t checksum = 0;
+
+  for (size_t window = 0; window < size; window += MEM_SIZE) {
+    size_t end = size - window < MEM_SIZE ? size - window : MEM_SIZE;
+    memcpy(sim->memory, stream + window, end);
+
+    /* generator never splits instructions across windows */
+    size_t ip = 0;
+    while (ip < end) {
+      struct instruction instruction = {0};
+      decode_instruction(sim, ip, &instruction);
+      checksum += instruction.type;
+      ip += instruction.bsize;
+    }
+  }
+
+  return checksum;
+}
+
+uint64_t bench_range(struct instruction *decoded, uint8_t *stream,
+                     size_t size) {
+  uint64_t checksum = 0;
+  size_t offset = 0;
+
+  while (offset < size) {
+    size_t used = 0;
+    size_t count = decode_range(stream + offset, size - offset, decoded,
+                                RANGE_CHUNK, &used);
+    if (count == 0) {
+      break;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+      checksum += decoded[i].type;
+    }
+
+    offset += used;
+  }
+
+  return checksum;
+}
+
+uint64_t bench_copy(uint8_t *copy, uint8_t *stream, size_t size) {
+  memcpy(copy, stream, size);
+  return copy[size - 1];
+}
+
+void print_result(char *name, uint64_t ns, uint64_t instructions,
+                  size_t size) {
+  printf("\t%-20s %8.2f ns/instr %10.1f MB/s\n", name,
+         instructions ? (double)ns / instructions : 0.0,
+         ns ? size / (ns / 1e9) / 1e6 : 0.0);
+}
+
+int main(int argc, char **argv) {
+  size_t size = 16 << 20;
+  int repeat = 5;
+
+  for (int arg_index = 1; arg_index < argc; ++arg_index) {
+    char *arg = argv[arg_index];
+
+    if (strncmp(arg, "--size=", 7) == 0) {
+      size = strtoull(arg + 7, NULL, 0);
+    } else if (strncmp(arg, "--repeat=", 9) == 0) {
+      repeat = atoi(arg + 9);
+    } else if (strncmp(arg, "--seed=", 7) == 0) {
+      generate_seed(strtoull(arg + 7, NULL, 0));
+    } else {
+      fprintf(stderr,
+              "usage: sim86_decode_bench [--size=BYTES] [--repeat=N] "
+              "[--seed=S]\n");
+      exit(1);
+    }
+  }
+
+  if (size < MEM_SIZE || repeat < 1) {
+    fprintf(stderr, "size must be at least %d bytes, repeat at least 1\n",
+            MEM_SIZE);
+    exit(1);
+  }
+
+  /* windows of sim memory size, so single decode never straddles them */
+  uint8_t *stream = malloc(size);
+  uint8_t *copy = malloc(size);
+  uint64_t instructions = 0;
+  size_t generated_size = 0;
+
+  for (size_t window = 0; window + MEM_SIZE <= size; window += MEM_SIZE) {
+    uint64_t count = 0;
+    size_t used = generate_instructions(stream + window, MEM_SIZE, UINT64_MAX,
+                                        &count);
+    memset(stream + window + used, 0x90, MEM_SIZE - used); /* xchg ax, ax */
+    instructions += count + (MEM_SIZE - used);
+    generated_size = window + MEM_SIZE;
+  }
+
+  size = generated_size;
+
+  struct sim86 *sim = sim86_create();
+  struct instruction *decoded = malloc(RANGE_CHUNK * sizeof(*decoded));
+  uint64_t best[3] = {UINT64_MAX, UINT64_MAX, UINT64_MAX};
+  uint64_t checksum[2] = {0};
+
+  for (int run = 0; run < repeat; ++run) {
+    uint64_t start = read_timer_ns();
+    checksum[0] = bench_single(sim, stream, size);
+    uint64_t single = read_timer_ns() - start;
+
+    start = read_timer_ns();
+    checksum[1] = bench_range(decoded, stream, size);
+    uint64_t range = read_timer_ns() - start;
+
+    start = read_timer_ns();
+    bench_copy(copy, stream, size);
+    uint64_t copied = read_timer_ns() - start;
+
+    best[0] = single < best[0] ? single : best[0];
+    best[1] = range < best[1] ? range : best[1];
+    best[2] = copied < best[2] ? copied : best[2];
+  }
+
+  printf("\nDecode benchmark:\n");
+  printf("\tstream: %zu bytes, %lu instructions, best of %d\n", size,
+         instructions, repeat);
+  print_result("decode_instruction", best[0], instructions, size);
+  print_result("decode_range", best[1], instructions, size);
+  print_result("memcpy", best[2], instructions, size);
+
+  if (checksum[0] != checksum[1]) {
+    printf("\tchecksum mismatch: %lu != %lu\n", checksum[0], checksum[1]);
+  }
+
+  free(decoded);
+  free(copy);
+  free(stream);
+  sim86_destroy(sim);
+
+  return checksum[0] != checksum[1];
+}
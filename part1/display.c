@@ -1,4 +1,9 @@
+#include "display.h"
+#include "clocks.h"
+#include "execute.h"
 #include "instruction.h"
+#include "string_ops.h"
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -70,12 +75,74 @@ char *inst_get_name(struct instruction *inst) {
     return "not used";
   case INST_POP:
     return "pop";
+  case INST_CALL:
+    return "call";
+  case INST_RET:
+    return "ret";
   case INST_XCHG:
     return "xchg";
   case INST_IN:
     return "in";
   case INST_OUT:
     return "out";
+  case INST_MOVS:
+    return "movs";
+  case INST_CMPS:
+    return "cmps";
+  case INST_SCAS:
+    return "scas";
+  case INST_LODS:
+    return "lods";
+  case INST_STOS:
+    return "stos";
+  case INST_CLD:
+    return "cld";
+  case INST_STD:
+    return "std";
+  case INST_ADC:
+    return "adc";
+  case INST_SBB:
+    return "sbb";
+  case INST_AND:
+    return "and";
+  case INST_OR:
+    return "or";
+  case INST_XOR:
+    return "xor";
+  case INST_TEST:
+    return "test";
+  case INST_INC:
+    return "inc";
+  case INST_DEC:
+    return "dec";
+  case INST_NEG:
+    return "neg";
+  case INST_NOT:
+    return "not";
+  case INST_MUL:
+    return "mul";
+  case INST_IMUL:
+    return "imul";
+  case INST_DIV:
+    return "div";
+  case INST_IDIV:
+    return "idiv";
+  case INST_ROL:
+    return "rol";
+  case INST_ROR:
+    return "ror";
+  case INST_RCL:
+    return "rcl";
+  case INST_RCR:
+    return "rcr";
+  case INST_SHL:
+    return "shl";
+  case INST_SHR:
+    return "shr";
+  case INST_SAR:
+    return "sar";
+  case INST_COUNT:
+    break;
   }
 
   return "";
@@ -87,7 +154,61 @@ char *get_register_name(struct register_access register_) {
   return reg_names[3 * (pos - 1) + offset];
 }
 
-void print_operand(struct operand op) {
+char *format_int(char *out, int32_t value) {
+  char digits[12];
+  uint8_t count = 0;
+  uint32_t magnitude = value < 0 ? -(uint32_t)value : (uint32_t)value;
+
+  if (value < 0) {
+    *out++ = '-';
+  }
+
+  do {
+    digits[count++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude != 0);
+
+  while (count > 0) {
+    *out++ = digits[--count];
+  }
+
+  return out;
+}
+
+char *format_hex(char *out, uint32_t value, uint8_t digits) {
+  static const char hex[] = "0123456789abcdef";
+
+  for (int8_t shift = (digits - 1) * 4; shift >= 0; shift -= 4) {
+    *out++ = hex[(value >> shift) & 0xf];
+  }
+
+  return out;
+}
+
+char *format_string(char *out, const char *string) {
+  while (*string) {
+    *out++ = *string++;
+  }
+
+  return out;
+}
+
+char *format_segment(char *out, enum register_type segment) {
+  return format_string(
+      out, get_register_name((struct register_access){segment, RegByte_All}));
+}
+
+char *format_relative(char *out, int32_t distance) {
+  *out++ = '$';
+  if (distance >= 0) {
+    *out++ = '+';
+  }
+
+  return format_int(out, distance);
+}
+
+char *format_operand(char *out, struct operand op,
+                     enum register_type segment) {
   switch (op.type) {
 
   case Operand_None: {
@@ -96,67 +217,221 @@ void print_operand(struct operand op) {
   case Operand_Register: {
     struct register_access reg = op.register_;
 
-    printf("%s", get_register_name(reg));
+    out = format_string(out, get_register_name(reg));
   } break;
 
   case Operand_Memory: {
     struct effective_address ea = op.memory;
 
-    printf("[");
+    *out++ = '[';
+    if (segment != Reg_None) {
+      out = format_segment(out, segment);
+      *out++ = ':';
+    }
+
     if (ea.type == EffectiveAddress_Direct) {
-      printf("%d", ea.displacement);
+      out = format_int(out, ea.displacement);
 
     } else {
-      printf("%s", ea_names[ea.type - 1]);
+      out = format_string(out, ea_names[ea.type - 1]);
 
       if (ea.displacement != 0) {
         if (ea.displacement > 0) {
-          printf(" +");
+          out = format_string(out, " +");
         }
 
-        printf(" %d", ea.displacement);
+        *out++ = ' ';
+        out = format_int(out, ea.displacement);
       }
     }
 
-    printf("]");
+    *out++ = ']';
   } break;
 
   case Operand_Immediate: {
     int16_t imm = op.immediate;
-    printf("%d", imm);
+    out = format_int(out, imm);
   } break;
 
   case Operand_RelativeImmediate: {
-    int16_t addr = op.immediate + 2;
+    /* jumps of two bytes, format_instruction() handles the rest */
+    out = format_relative(out, op.immediate + 2);
+  } break;
+  }
 
-    printf("$");
-    if (addr >= 0) {
-      printf("+");
-    }
+  return out;
+}
 
-    printf("%d", addr);
-  } break;
+char *format_prefixes(char *out, struct instruction *inst) {
+  if (inst->prefixes & PREFIX_LOCK) {
+    out = format_string(out, "lock ");
+  }
+
+  if (inst->prefixes & PREFIX_REP) {
+    out = format_string(out, "rep ");
+  } else if (inst->prefixes & PREFIX_REPNE) {
+    out = format_string(out, "repne ");
   }
+
+  return out;
 }
 
-void print_instruction(struct instruction *inst) {
-  printf("%s ", inst_get_name(inst));
+size_t format_instruction(struct instruction *inst, char *out) {
+  char *end = format_prefixes(out, inst);
+
+  if (is_string(inst->type)) {
+    /* operands are implied, segment override applies to source */
+    if (inst->prefixes & PREFIX_SEGMENT) {
+      end = format_segment(end, inst->segment);
+      *end++ = ' ';
+    }
+
+    end = format_string(end, inst_get_name(inst));
+    *end++ = (inst->flags & F_W) ? 'w' : 'b';
+    return end - out;
+  }
+
+  end = format_string(end, inst_get_name(inst));
+  if (inst->operand[0].type == Operand_None) {
+    return end - out;
+  }
 
+  *end++ = ' ';
+
+  /* CL as shift count tells nothing about size of the other operand */
   uint8_t has_size_prefix =
       inst->operand[0].type != Operand_Register &&
       inst->operand[0].type != Operand_RelativeImmediate &&
-      inst->operand[1].type != Operand_Register;
+      inst->operand[0].type != Operand_Immediate &&
+      (inst->operand[1].type != Operand_Register || (inst->flags & F_V));
 
   if (has_size_prefix) {
-    printf((inst->flags & F_W) ? "word " : "byte ");
+    end = format_string(end, (inst->flags & F_W) ? "word " : "byte ");
   }
 
-  if (inst->operand[0].type != Operand_None) {
-    print_operand(inst->operand[0]);
+  /* distance counts from start of instruction, whatever its size */
+  if (inst->operand[0].type == Operand_RelativeImmediate) {
+    end = format_relative(end, inst->operand[0].immediate + inst->bsize);
+  } else {
+    end = format_operand(end, inst->operand[0], inst->segment);
   }
 
   if (inst->operand[1].type != Operand_None) {
-    printf(", ");
-    print_operand(inst->operand[1]);
+    end = format_string(end, ", ");
+    end = format_operand(end, inst->operand[1], inst->segment);
+  }
+
+  return end - out;
+}
+
+char *format_label(char *out, uint16_t address) {
+  out = format_string(out, "label_");
+  return format_hex(out, address, 4);
+}
+
+size_t format_branch(struct instruction *inst, uint16_t target, char *out) {
+  char *end = format_string(out, inst_get_name(inst));
+  *end++ = ' ';
+  end = format_label(end, target);
+
+  return end - out;
+}
+
+void print_instruction(struct instruction *inst) {
+  char text[MAX_FORMATTED_SIZE];
+  fwrite(text, 1, format_instruction(inst, text), stdout);
+}
+
+void writer_init(struct text_writer *writer, FILE *f) {
+  writer->f = f;
+  writer->used = 0;
+}
+
+char *writer_reserve(struct text_writer *writer, size_t n) {
+  if (writer->used + n > WRITER_BUFFER_SIZE) {
+    writer_flush(writer);
+  }
+
+  return writer->buf + writer->used;
+}
+
+void writer_commit(struct text_writer *writer, size_t n) {
+  writer->used += n;
+}
+
+void writer_flush(struct text_writer *writer) {
+  fwrite(writer->buf, 1, writer->used, writer->f);
+  writer->used = 0;
+}
+
+void print_registers(struct register_state *state) {
+  printf("\nFinal registers:\n");
+
+  printf("\tax: 0x%x (%d)\n", state->regs[0], state->regs[0]);
+  printf("\tbx: 0x%x (%d)\n", state->regs[1], state->regs[1]);
+  printf("\tcx: 0x%x (%d)\n", state->regs[2], state->regs[2]);
+  printf("\tdx: 0x%x (%d)\n", state->regs[3], state->regs[3]);
+  printf("\tsp: 0x%x (%d)\n", state->regs[4], state->regs[4]);
+  printf("\tbp: 0x%x (%d)\n", state->regs[5], state->regs[5]);
+  printf("\tsi: 0x%x (%d)\n", state->regs[6], state->regs[6]);
+  printf("\tdi: 0x%x (%d)\n", state->regs[7], state->regs[7]);
+
+  printf("\tip: 0x%x (%d)\n", state->ip, state->ip);
+}
+
+void print_flags(uint16_t flags) {
+  enum op_flag order[] = {CF, PF, AF, ZF, SF, DF, OF};
+  char names[] = "CPAZSDO";
+
+  for (int i = 0; i < 7; ++i) {
+    if (flags & order[i]) {
+      printf("%c", names[i]);
+    }
+  }
+}
+
+void print_state_change(struct instruction_timing *timing,
+                        uint64_t total_clocks, struct register_state *before,
+                        struct register_state *after) {
+  printf(" ;");
+
+  if (timing != NULL) {
+    /* data dependent clocks show as range, total counts the minimum */
+    printf(" Clocks: +%u", timing->min);
+    if (timing->max != timing->min) {
+      printf("..%u", timing->max);
+    }
+
+    printf(" = %llu", (unsigned long long)total_clocks);
+    if (timing->ea != 0 || timing->penalty != 0) {
+      printf(" (%u", timing->base_min);
+      if (timing->base_max != timing->base_min)
+        printf("..%u", timing->base_max);
+      if (timing->ea != 0)
+        printf(" + %dea", timing->ea);
+      if (timing->penalty != 0)
+        printf(" + %up", timing->penalty);
+      printf(")");
+    }
+    printf(" |");
+  }
+
+  for (int i = 0; i < 8; ++i) {
+    if (before->regs[i] != after->regs[i]) {
+      printf(" %s:0x%x->0x%x", reg_names[i * 3 + 2], before->regs[i],
+             after->regs[i]);
+    }
+  }
+
+  if (before->ip != after->ip) {
+    printf(" ip:0x%x->0x%x", before->ip, after->ip);
+  }
+
+  if (before->flags != after->flags) {
+    printf(" flags:");
+
+    print_flags(before->flags);
+    printf("->");
+    print_flags(after->flags);
   }
 }
@@ -1,11 +1,58 @@
 #if !defined DISPLAY_H
 #define DISPLAY_H
 
+#include "clocks.h"
+#include "execute.h"
 #include "instruction.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* longest text of a formatted instruction, with room to spare */
+#define MAX_FORMATTED_SIZE 64
+#define WRITER_BUFFER_SIZE (1 << 16)
+
+/* collects text in memory and writes it to f in large blocks */
+struct text_writer {
+  FILE *f;
+  size_t used;
+  char buf[WRITER_BUFFER_SIZE];
+};
 
 extern char reg_names[36][3];
 extern char ea_names[8][8];
 
+char *inst_get_name(struct instruction *inst);
 char *get_register_name(struct register_access register_);
+char *format_int(char *out, int32_t value);
+char *format_hex(char *out, uint32_t value, uint8_t digits);
+char *format_string(char *out, const char *string);
+char *format_segment(char *out, enum register_type segment);
+/* Writes "$+distance", distance counted from start of instruction. */
+char *format_relative(char *out, int32_t distance);
+/* segment is override put inside brackets of memory operand, or Reg_None */
+char *format_operand(char *out, struct operand op,
+                     enum register_type segment);
+char *format_prefixes(char *out, struct instruction *inst);
+
+/*
+Writes NASM syntax of inst to out, which needs MAX_FORMATTED_SIZE bytes.
+Text is not terminated, returns its length.
+*/
+size_t format_instruction(struct instruction *inst, char *out);
+char *format_label(char *out, uint16_t address);
+/* Same as format_instruction() for a jump, naming its target by label. */
+size_t format_branch(struct instruction *inst, uint16_t target, char *out);
+void print_instruction(struct instruction *inst);
+
+void writer_init(struct text_writer *writer, FILE *f);
+/* returns room for n bytes, flushing buffered text when it does not fit */
+char *writer_reserve(struct text_writer *writer, size_t n);
+void writer_commit(struct text_writer *writer, size_t n);
+void writer_flush(struct text_writer *writer);
+void print_registers(struct register_state *state);
+void print_state_change(struct instruction_timing *timing,
+                        uint64_t total_clocks, struct register_state *before,
+                        struct register_state *after);
 
 #endif // DISPLAY_H
@@ -0,0 +1,209 @@
+#include "encode.h"
+#include "decode.h"
+#include "instruction.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* inverse of get_register_operand(), -1 when register has no index */
+int8_t register_index(struct register_access reg, bool wide) {
+  static const int8_t low[] = {[Reg_A] = 0, [Reg_C] = 1, [Reg_D] = 2,
+                               [Reg_B] = 3};
+  static const int8_t all[] = {[Reg_A] = 0,  [Reg_C] = 1,  [Reg_D] = 2,
+                               [Reg_B] = 3,  [Reg_SP] = 4, [Reg_BP] = 5,
+                               [Reg_SI] = 6, [Reg_DI] = 7};
+
+  if (reg.type == Reg_None || reg.type >= Reg_ES) {
+    return -1;
+  }
+
+  if (wide) {
+    return reg.byte == RegByte_All ? all[reg.type] : -1;
+  }
+
+  if (reg.type > Reg_D || reg.byte == RegByte_All) {
+    return -1;
+  }
+
+  return low[reg.type] + (reg.byte == RegByte_High ? 4 : 0);
+}
+
+/* inverse of get_segment_register_operand() */
+int8_t segment_register_index(struct register_access reg) {
+  if (reg.type < Reg_ES || reg.type > Reg_DS) {
+    return -1;
+  }
+
+  return reg.type - Reg_ES;
+}
+
+/* inverse of get_effective_address_type() for memory operands */
+uint8_t effective_address_index(enum effective_address_type type) {
+  static const uint8_t table[] = {
+      [EffectiveAddress_Direct] = 0b110, [EffectiveAddress_BX_SI] = 0b000,
+      [EffectiveAddress_BX_DI] = 0b001,  [EffectiveAddress_BP_SI] = 0b010,
+      [EffectiveAddress_BP_DI] = 0b011,  [EffectiveAddress_SI] = 0b100,
+      [EffectiveAddress_DI] = 0b101,     [EffectiveAddress_BP] = 0b110,
+      [EffectiveAddress_BX] = 0b111,
+  };
+
+  return table[type];
+}
+
+void put_u16(uint8_t *out, uint8_t *n, uint16_t value) {
+  out[(*n)++] = value & 0xff;
+  out[(*n)++] = value >> 8;
+}
+
+/*
+Encodes rm operand into mod and rm bits, appending displacement to out.
+Returns false when operand cannot be encoded.
+*/
+bool encode_rm(struct operand *op, bool wide, uint8_t *modrm, uint8_t *out,
+               uint8_t *n) {
+  if (op->type == Operand_Register) {
+    int8_t index = register_index(op->register_, wide);
+    if (index < 0) {
+      return false;
+    }
+
+    *modrm |= (MOD_REG << 6) | index;
+    return true;
+  }
+
+  if (op->type != Operand_Memory) {
+    return false;
+  }
+
+  int16_t disp = op->memory.displacement;
+  uint8_t rm = effective_address_index(op->memory.type);
+
+  if (op->memory.type == EffectiveAddress_Direct) {
+    *modrm |= (MOD_MEM << 6) | rm;
+    put_u16(out, n, disp);
+  } else if (disp == 0 && op->memory.type != EffectiveAddress_BP) {
+    *modrm |= (MOD_MEM << 6) | rm;
+  } else if (disp >= -128 && disp <= 127) {
+    *modrm |= (MOD_MEM8 << 6) | rm;
+    out[(*n)++] = (uint8_t)disp;
+  } else {
+    *modrm |= (MOD_MEM16 << 6) | rm;
+    put_u16(out, n, disp);
+  }
+
+  return true;
+}
+
+uint8_t encode_instruction(struct instruction *inst,
+                           uint8_t out[MAX_INSTRUCTION_SIZE]) {
+  struct instruction_encoding enc = instructions[inst->opcode];
+  uint8_t n = 0;
+
+  if (enc.size == 0) {
+    return 0;
+  }
+
+  bool D = enc.fields & F_D;
+  bool W = enc.fields & F_W;
+  bool rm_is_w = (enc.fields & RM_ALWAYS_W) || W;
+
+  struct operand *reg_op = &inst->operand[D ? 0 : 1];
+  struct operand *rm_op = &inst->operand[D ? 1 : 0];
+
+  /* decoder accepts prefixes in any order, they are encoded in one */
+  if (inst->prefixes & PREFIX_LOCK) {
+    out[n++] = 0xF0;
+  }
+
+  if (inst->prefixes & PREFIX_REP) {
+    out[n++] = 0xF3;
+  } else if (inst->prefixes & PREFIX_REPNE) {
+    out[n++] = 0xF2;
+  }
+
+  if (inst->prefixes & PREFIX_SEGMENT) {
+    int8_t index = segment_register_index(
+        (struct register_access){.type = inst->segment});
+    if (index < 0) {
+      return 0;
+    }
+
+    out[n++] = 0x26 | index << 3;
+  }
+
+  out[n++] = inst->opcode;
+
+  if (enc.size == WORD) {
+    uint8_t modrm = 0;
+    uint8_t disp[2];
+    uint8_t disp_size = 0;
+
+    if (enc.extended == EXTENDED) {
+      int8_t ext = -1;
+      for (int8_t i = 0; i < 8 && ext < 0; ++i) {
+        if (enc.types[i] == inst->type) {
+          ext = i;
+        }
+      }
+
+      if (ext < 0) {
+        return 0;
+      }
+
+      modrm |= ext << 3;
+
+      if ((enc.fields & EXT0_DATA) && ext != 0) {
+        enc.fields &= ~DATA;
+      }
+    }
+
+    if (enc.fields & REG) {
+      int8_t index = register_index(reg_op->register_, W);
+      if (reg_op->type != Operand_Register || index < 0) {
+        return 0;
+      }
+
+      modrm |= index << 3;
+    }
+
+    if (enc.fields & SR) {
+      int8_t index = segment_register_index(reg_op->register_);
+      if (reg_op->type != Operand_Register || index < 0) {
+        return 0;
+      }
+
+      modrm |= index << 3;
+    }
+
+    if ((enc.fields & RM) &&
+        !encode_rm(rm_op, rm_is_w, &modrm, disp, &disp_size)) {
+      return 0;
+    }
+
+    out[n++] = modrm;
+    for (uint8_t i = 0; i < disp_size; ++i) {
+      out[n++] = disp[i];
+    }
+  } else if ((enc.fields & RM) && rm_op->type == Operand_Memory) {
+    /* fixed fields select direct address, as in MOV to/from accumulator */
+    put_u16(out, &n, rm_op->memory.displacement);
+  }
+
+  struct operand *imm_op = &inst->operand[0];
+  if (imm_op->type == Operand_Immediate ||
+      imm_op->type == Operand_RelativeImmediate) {
+    /* immediate is the only operand */
+  } else {
+    imm_op = &inst->operand[1];
+  }
+
+  bool is_imm_wide =
+      (enc.fields & DATA) && (enc.fields & F_W) && !(enc.fields & F_S);
+
+  if (is_imm_wide || (enc.fields & ADDR16)) {
+    put_u16(out, &n, imm_op->immediate);
+  } else if (enc.fields & (DATA | DATA8 | ADDR)) {
+    out[n++] = (uint8_t)imm_op->immediate;
+  }
+
+  return n;
+}
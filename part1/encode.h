@@ -0,0 +1,15 @@
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include "instruction.h"
+#include <stdint.h>
+
+/*
+Turns decoded instruction back into machine bytes using the encoding of its
+opcode. Displacements take the shortest form, as nasm emits them. Returns
+number of bytes written to out, or 0 when operands do not fit the opcode.
+*/
+uint8_t encode_instruction(struct instruction *inst,
+                           uint8_t out[MAX_INSTRUCTION_SIZE]);
+
+#endif // ENCODE_H
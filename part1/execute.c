@@ -1,96 +1,63 @@
 #include "execute.h"
+#include "arith.h"
+#include "branches.h"
+#include "cache.h"
+#include "callgraph.h"
 #include "clocks.h"
 #include "display.h"
+#include "flags.h"
 #include "instruction.h"
+#include "io.h"
 #include "memory.h"
+#include "profile.h"
+#include "sim86.h"
+#include "string_ops.h"
+#include "timing_model.h"
+#include "trace.h"
+#include "watchdog.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <sys/types.h>
 
-/*
-0 - al, ah, ax
-1 - bl, bh, bx
-2 - cl, ch, cx
-3 - dl, dh, dx
-4 - sp
-5 - bp
-6 - si
-7 - di
-*/
-uint16_t reg_table[8] = {0};
-uint16_t original_reg_table[8] = {0};
-
-enum op_flag : uint16_t { ZF = 0x20, SF = 0x40 };
-uint16_t op_flags = 0;
-uint16_t original_op_flags = 0;
-
-uint16_t ip = 0;
-uint16_t original_ip = 0;
-
-uint16_t total_clocks = 0;
+bool print_execution = true;
 
-void print_registers_state() {
-  printf("\nFinal registers:\n");
-
-  printf("\tax: 0x%x (%d)\n", reg_table[0], reg_table[0]);
-  printf("\tbx: 0x%x (%d)\n", reg_table[1], reg_table[1]);
-  printf("\tcx: 0x%x (%d)\n", reg_table[2], reg_table[2]);
-  printf("\tdx: 0x%x (%d)\n", reg_table[3], reg_table[3]);
-  printf("\tsp: 0x%x (%d)\n", reg_table[4], reg_table[4]);
-  printf("\tbp: 0x%x (%d)\n", reg_table[5], reg_table[5]);
-  printf("\tsi: 0x%x (%d)\n", reg_table[6], reg_table[6]);
-  printf("\tdi: 0x%x (%d)\n", reg_table[7], reg_table[7]);
+void get_register_state(struct sim86 *sim, struct register_state *state) {
+  for (int i = 0; i < 8; ++i) {
+    state->regs[i] = sim->regs[i];
+  }
 
-  printf("\tip: 0x%x (%d)\n", ip, ip);
+  state->ip = sim->ip;
+  state->flags = flags_get(sim);
 }
 
-void print_executinon_change(struct instruction_timing *timing) {
-  printf(" ;");
-
-  if (timing != NULL) {
-    // NOTE:
-    // Range is omited because currently I do not implemented instruction that
-    // have ranged clocks
-    printf(" Clocks: +%d = %d", timing->min, total_clocks);
-    if (timing->ea != 0)
-      printf(" (%d + %dea)", timing->base_min, timing->ea);
-    printf(" |");
-  }
-
+void set_register_state(struct sim86 *sim, struct register_state *state) {
   for (int i = 0; i < 8; ++i) {
-    if (original_reg_table[i] != reg_table[i]) {
-      printf(" %s:0x%x->0x%x", reg_names[i * 3 + 2], original_reg_table[i],
-             reg_table[i]);
-    }
-  }
-
-  if (original_ip != ip) {
-    printf(" ip:0x%x->0x%x", original_ip, ip);
+    sim->regs[i] = state->regs[i];
   }
 
-  if (original_op_flags != op_flags) {
-    printf(" flags:");
-
-    if (original_op_flags & ZF)
-      printf("Z");
-
-    if (original_op_flags & SF)
-      printf("S");
-
-    printf("->");
+  sim->ip = state->ip;
+  flags_set(sim, state->flags);
+  sim->previous = *state;
+}
 
-    if (op_flags & ZF)
-      printf("Z");
+void print_registers_state(struct sim86 *sim) {
+  struct register_state state;
+  get_register_state(sim, &state);
+  print_registers(&state);
+}
 
-    if (op_flags & SF)
-      printf("S");
-  }
+void print_executinon_change(struct sim86 *sim,
+                             struct instruction_timing *timing) {
+  struct register_state state;
+  get_register_state(sim, &state);
+  print_state_change(timing, sim->total_clocks, &sim->previous, &state);
 }
 
-void set_register(struct register_access reg, uint16_t value) {
-  uint16_t *reg_ptr = &reg_table[reg.type - 1];
+void set_register(struct sim86 *sim, struct register_access reg,
+                  uint16_t value) {
+  uint16_t *reg_ptr = &sim->regs[reg.type - 1];
 
   switch (reg.byte) {
   case RegByte_Low: {
@@ -107,61 +74,98 @@ void set_register(struct register_access reg, uint16_t value) {
   }
 }
 
-uint16_t get_reg_value(struct register_access reg) {
-  uint16_t value = reg_table[reg.type - 1];
+uint16_t get_reg_value(struct sim86 *sim, struct register_access reg) {
+  uint16_t value = sim->regs[reg.type - 1];
 
   switch (reg.byte) {
   case RegByte_Low:
     return 0x00FF & value;
 
   case RegByte_High:
-    return value & 0xFF00;
+    return value >> 8;
 
   case RegByte_All:
     return value;
   }
 }
 
-uint16_t get_memory_value(struct effective_address memaddr) {
+uint16_t get_effective_address(struct sim86 *sim,
+                               struct effective_address memaddr) {
+  uint16_t bx = sim->regs[Reg_B - 1];
+  uint16_t bp = sim->regs[Reg_BP - 1];
+  uint16_t si = sim->regs[Reg_SI - 1];
+  uint16_t di = sim->regs[Reg_DI - 1];
+  uint16_t base = 0;
+
   switch (memaddr.type) {
-  case EffectiveAddress_Direct: {
-    return mem_read_word(memaddr.displacement);
-  }
+  case EffectiveAddress_Direct:
+    break;
 
-  case EffectiveAddress_BX: {
-    struct register_access bx_reg = {Reg_B, RegByte_All};
-    uint16_t bx_val = get_reg_value(bx_reg);
-    return mem_read_word(bx_val + memaddr.displacement);
-  }
+  case EffectiveAddress_BX_SI:
+    base = bx + si;
+    break;
 
-  case EffectiveAddress_BP_SI: {
-    uint16_t bp_val =
-        get_reg_value((struct register_access){Reg_BP, RegByte_All});
-    uint16_t si_val =
-        get_reg_value((struct register_access){Reg_SI, RegByte_All});
+  case EffectiveAddress_BX_DI:
+    base = bx + di;
+    break;
 
-    return mem_read_word(bp_val + si_val);
-  } break;
+  case EffectiveAddress_BP_SI:
+    base = bp + si;
+    break;
 
-  default:
+  case EffectiveAddress_BP_DI:
+    base = bp + di;
+    break;
+
+  case EffectiveAddress_SI:
+    base = si;
+    break;
+
+  case EffectiveAddress_DI:
+    base = di;
+    break;
+
+  case EffectiveAddress_BP:
+    base = bp;
+    break;
+
+  case EffectiveAddress_BX:
+    base = bx;
     break;
   }
 
+  return base + memaddr.displacement;
+}
+
+uint16_t memory_operand_address(struct sim86 *sim,
+                                struct instruction *instruction) {
+  for (int i = 0; i < 2; ++i) {
+    if (instruction->operand[i].type == Operand_Memory) {
+      return get_effective_address(sim, instruction->operand[i].memory);
+    }
+  }
+
   return 0;
 }
 
-uint16_t get_value(struct operand op) {
+uint16_t get_memory_value(struct sim86 *sim, struct effective_address memaddr,
+                          uint16_t width) {
+  uint16_t addr = get_effective_address(sim, memaddr);
+  return width == 2 ? mem_read_word(sim, addr) : mem_read_byte(sim, addr);
+}
+
+uint16_t get_value(struct sim86 *sim, struct operand op, uint16_t width) {
   switch (op.type) {
 
   case Operand_None: {
   } break;
 
   case Operand_Register: {
-    return get_reg_value(op.register_);
+    return get_reg_value(sim, op.register_);
   } break;
 
   case Operand_Memory: {
-    return get_memory_value(op.memory);
+    return get_memory_value(sim, op.memory, width);
   } break;
 
   case Operand_Immediate:
@@ -172,50 +176,30 @@ uint16_t get_value(struct operand op) {
   return 0;
 }
 
-void store_to_memory(struct effective_address memaddr, uint16_t value) {
-  switch (memaddr.type) {
-  case EffectiveAddress_Direct: {
-    mem_save_word(memaddr.displacement, value);
-  } break;
-
-  case EffectiveAddress_BX: {
-    struct register_access bx_reg = {Reg_B, RegByte_All};
-    uint16_t bx_val = get_reg_value(bx_reg);
-    mem_save_word(bx_val + memaddr.displacement, value);
-  } break;
-
-  case EffectiveAddress_BP: {
-    struct register_access bp_reg = {Reg_BP, RegByte_All};
-    uint16_t bp_val = get_reg_value(bp_reg);
-    mem_save_word(bp_val + memaddr.displacement, value);
-  } break;
+void store_to_memory(struct sim86 *sim, struct effective_address memaddr,
+                     uint16_t value, uint16_t width) {
+  uint16_t addr = get_effective_address(sim, memaddr);
 
-  case EffectiveAddress_BP_SI: {
-    uint16_t bp_val =
-        get_reg_value((struct register_access){Reg_BP, RegByte_All});
-    uint16_t si_val =
-        get_reg_value((struct register_access){Reg_SI, RegByte_All});
-
-    mem_save_word(bp_val + si_val, value);
-  } break;
-
-  default:
-    break;
+  if (width == 2) {
+    mem_save_word(sim, addr, value);
+  } else {
+    mem_save_byte(sim, addr, value);
   }
 }
 
-void save_value(struct operand op, uint16_t value) {
+void save_value(struct sim86 *sim, struct operand op, uint16_t value,
+                uint16_t width) {
   switch (op.type) {
 
   case Operand_None: {
   } break;
 
   case Operand_Register: {
-    set_register(op.register_, value);
+    set_register(sim, op.register_, value);
   } break;
 
   case Operand_Memory: {
-    store_to_memory(op.memory, value);
+    store_to_memory(sim, op.memory, value, width);
   } break;
 
   case Operand_Immediate: {
@@ -226,85 +210,331 @@ void save_value(struct operand op, uint16_t value) {
   }
 }
 
-void update_state() {
-  for (int i = 0; i < 8; ++i) {
-    original_reg_table[i] = reg_table[i];
-  }
+/* Stores word below top of stack and moves SP down to it. */
+void stack_push(struct sim86 *sim, uint16_t value,
+                struct timing_state *state) {
+  uint16_t sp = sim->regs[Reg_SP - 1] - 2;
 
-  original_ip = ip;
-  original_op_flags = op_flags;
+  sim->regs[Reg_SP - 1] = sp;
+  state->stack = sp;
+  mem_save_word(sim, sp, value);
 }
 
-void update_flags(uint16_t value, uint16_t width) {
-  uint16_t signBit = width == 1 ? 1 << 7 : 1 << 15;
+/* Loads word at top of stack and moves SP above it. */
+uint16_t stack_pop(struct sim86 *sim, struct timing_state *state) {
+  uint16_t sp = sim->regs[Reg_SP - 1];
+
+  sim->regs[Reg_SP - 1] = sp + 2;
+  state->stack = sp;
+  return mem_read_word(sim, sp);
+}
 
-  op_flags = 0;
-  op_flags |= value == 0 ? ZF : 0;
-  op_flags |= value & signBit ? SF : 0;
+void update_state(struct sim86 *sim) {
+  get_register_state(sim, &sim->previous);
 }
 
 uint16_t mask_value(uint16_t value, uint16_t width) {
   return value & (width == 1 ? 0xff : 0xffff);
 }
 
-struct execute_result execute_instruction(struct instruction *instruction) {
-  struct execute_result result = {};
-  struct timing_state state = {};
+/*
+Whether instruction overwrites its destination without reading it, so a
+memory destination must not count as a read.
+*/
+bool writes_only_destination(enum instruction_type type) {
+  return type == INST_MOV || type == INST_POP || type == INST_IN;
+}
+
+bool apply_instruction(struct sim86 *sim, struct instruction *instruction,
+                       struct timing_state *state) {
+  if (instruction->handler != NULL) {
+    sim->ip += instruction->bsize;
+    state->jumpTaken = instruction->handler(sim, instruction);
+    return true;
+  }
+
   struct operand destination = instruction->operand[0];
   struct operand source = instruction->operand[1];
 
-  ip += instruction->bsize;
-  result.next_ip = ip;
+  sim->ip += instruction->bsize;
+
+  if (is_branch(instruction->type)) {
+    state->jumpTaken = evaluate_jump(sim, instruction->type);
+    if (state->jumpTaken) {
+      sim->ip += instruction->operand[0].immediate;
+    }
+
+    return true;
+  }
+
+  if (is_string(instruction->type)) {
+    execute_string(sim, instruction, state);
+    return true;
+  }
 
   uint16_t width = instruction->flags & F_W ? 2 : 1;
-  uint16_t value_dst = get_value(destination);
-  uint16_t value_src = get_value(source);
+  uint16_t value_dst = writes_only_destination(instruction->type)
+                           ? 0
+                           : get_value(sim, destination, width);
+  uint16_t value_src = get_value(sim, source, width);
 
   switch (instruction->type) {
   case INST_MOV: {
-    save_value(destination, value_src);
+    save_value(sim, destination, value_src, width);
   } break;
 
   case INST_ADD: {
-    uint16_t v = mask_value(
-        mask_value(value_dst, width) + mask_value(value_src, width), width);
-
-    update_flags(v, width);
-    save_value(destination, v);
+    uint16_t v = alu_add(sim, value_dst, value_src, width);
+    save_value(sim, destination, v, width);
   } break;
 
   case INST_SUB: {
-    uint16_t v = mask_value(
-        mask_value(value_dst, width) - mask_value(value_src, width), width);
-
-    update_flags(v, width);
-    save_value(destination, v);
+    uint16_t v = alu_sub(sim, value_dst, value_src, width);
+    save_value(sim, destination, v, width);
   } break;
 
   case INST_CMP: {
-    uint16_t v = mask_value(
-        mask_value(value_dst, width) - mask_value(value_src, width), width);
+    alu_sub(sim, value_dst, value_src, width);
+  } break;
+
+  case INST_ADC: {
+    uint16_t v = alu_adc(sim, value_dst, value_src, width);
+    save_value(sim, destination, v, width);
+  } break;
+
+  case INST_SBB: {
+    uint16_t v = alu_sbb(sim, value_dst, value_src, width);
+    save_value(sim, destination, v, width);
+  } break;
+
+  case INST_AND: {
+    uint16_t v = alu_and(sim, value_dst, value_src, width);
+    save_value(sim, destination, v, width);
+  } break;
+
+  case INST_OR: {
+    uint16_t v = alu_or(sim, value_dst, value_src, width);
+    save_value(sim, destination, v, width);
+  } break;
+
+  case INST_XOR: {
+    uint16_t v = alu_xor(sim, value_dst, value_src, width);
+    save_value(sim, destination, v, width);
+  } break;
+
+  case INST_TEST: {
+    alu_and(sim, value_dst, value_src, width);
+  } break;
+
+  case INST_INC: {
+    uint16_t v = alu_inc(sim, value_dst, width);
+    save_value(sim, destination, v, width);
+  } break;
+
+  case INST_DEC: {
+    uint16_t v = alu_dec(sim, value_dst, width);
+    save_value(sim, destination, v, width);
+  } break;
 
-    update_flags(v, width);
+  case INST_NEG: {
+    uint16_t v = alu_sub(sim, 0, value_dst, width);
+    save_value(sim, destination, v, width);
   } break;
 
-  case INST_JNZ: {
-    if ((op_flags & ZF) == 0) {
-      int16_t addr = get_value(instruction->operand[0]);
-      ip += addr;
+  case INST_NOT: {
+    save_value(sim, destination, mask_value(~value_dst, width), width);
+  } break;
+
+  case INST_MUL:
+  case INST_IMUL:
+  case INST_DIV:
+  case INST_IDIV: {
+    if (!multiply_divide(sim, instruction->type, value_dst, width)) {
+      sim->divide_error = true;
+      sim->ip -= instruction->bsize;
+      return false;
     }
   } break;
 
+  case INST_ROL:
+  case INST_ROR:
+  case INST_RCL:
+  case INST_RCR:
+  case INST_SHL:
+  case INST_SHR:
+  case INST_SAR: {
+    state->operand = value_src & 0xff;
+    state->operand_known = true;
+
+    uint16_t v = shift_rotate(sim, instruction->type, value_dst,
+                              value_src & 0xff, width);
+    save_value(sim, destination, v, width);
+  } break;
+
+  case INST_CLD:
+  case INST_STD: {
+    flag_assign(sim, DF, instruction->type == INST_STD);
+  } break;
+
+  case INST_PUSH: {
+    /* 8086 stores SP as it is after the decrement */
+    bool is_sp = destination.type == Operand_Register &&
+                 destination.register_.type == Reg_SP;
+    stack_push(sim, is_sp ? value_dst - 2 : value_dst, state);
+  } break;
+
+  case INST_POP: {
+    save_value(sim, destination, stack_pop(sim, state), width);
+  } break;
+
+  case INST_CALL: {
+    /* target is taken before return address goes on stack */
+    uint16_t target = destination.type == Operand_RelativeImmediate
+                          ? sim->ip + value_dst
+                          : value_dst;
+    stack_push(sim, sim->ip, state);
+    sim->ip = target;
+  } break;
+
+  case INST_RET: {
+    /* immediate form also releases that many bytes of arguments */
+    sim->ip = stack_pop(sim, state);
+    sim->regs[Reg_SP - 1] += value_dst;
+  } break;
+
+  /* port is the immediate or DX, accumulator is the other operand */
+  case INST_IN: {
+    state->address = value_src;
+    save_value(sim, destination, io_in(sim, value_src, width), width);
+  } break;
+
+  case INST_OUT: {
+    state->address = value_dst;
+    io_out(sim, value_dst, value_src, width);
+  } break;
+
   default:
-    printf("unsupported instruction\n");
+    sim->ip -= instruction->bsize;
+    return false;
+  }
+
+  return true;
+}
+
+bool instruction_is_implemented(struct instruction *instruction) {
+  switch (instruction->type) {
+  case INST_MOV:
+  case INST_ADD:
+  case INST_SUB:
+  case INST_CMP:
+  case INST_CLD:
+  case INST_STD:
+  case INST_ADC:
+  case INST_SBB:
+  case INST_AND:
+  case INST_OR:
+  case INST_XOR:
+  case INST_TEST:
+  case INST_INC:
+  case INST_DEC:
+  case INST_NEG:
+  case INST_NOT:
+  case INST_PUSH:
+  case INST_POP:
+  case INST_CALL:
+  case INST_RET:
+  case INST_IN:
+  case INST_OUT:
+    return true;
+
+  default:
+    return is_branch(instruction->type) || is_string(instruction->type) ||
+           is_multiply_divide(instruction->type) ||
+           is_shift(instruction->type);
+  }
+}
+
+struct execute_result execute_instruction(struct sim86 *sim,
+                                          struct instruction *instruction) {
+  struct execute_result result = {};
+  struct timing_state state = {};
+  uint16_t instruction_ip = sim->ip;
+
+  /* operands are evaluated before instruction changes registers */
+  state.address = memory_operand_address(sim, instruction);
+  sim->divide_error = false;
+
+  if (cache_enabled) {
+    cache_fetch(sim, instruction_ip, instruction->bsize);
+  }
+
+  if (!apply_instruction(sim, instruction, &state)) {
+    if (sim->divide_error) {
+      /* interrupts are not simulated, so INT 0 stops the program */
+      printf("divide error\n");
+    } else {
+      printf("unsupported instruction\n");
+    }
+
+    if (trace_enabled && sim->divide_error) {
+      trace_divide_error(sim->ip);
+    } else if (trace_enabled) {
+      trace_unsupported(sim->ip);
+    }
+
+    result.next_ip = sim->ip;
     result.unimplemented = true;
     return result;
   }
 
+  result.next_ip = sim->ip;
   result.timing = get_timing(instruction, &state);
-  total_clocks += result.timing.min;
-  print_executinon_change(&result.timing);
-  update_state();
+  sim->total_clocks += result.timing.min;
+  sim->instructions++;
+
+  if (watchdog.detect_hangs && state.jumpTaken &&
+      is_branch(instruction->type) && sim->ip <= instruction_ip) {
+    watchdog_backward_branch(sim, instruction_ip, instruction->bsize, sim->ip);
+  }
+
+  if (callgraph_enabled &&
+      (instruction->type == INST_CALL || instruction->type == INST_RET)) {
+    callgraph_record(sim, instruction->type, state.stack);
+  }
+
+  if (timing_models_enabled) {
+    struct timing_event event = {
+        .instruction = instruction,
+        .state = &state,
+        .clocks = result.timing.min - result.timing.penalty,
+        .taken = state.jumpTaken || instruction->type == INST_CALL ||
+                 instruction->type == INST_RET,
+    };
+    timing_models_record(&event);
+  }
+
+  if (profile_enabled) {
+    profile_record(instruction_ip, instruction->type, result.timing.min);
+  }
+
+  if (branch_stats_enabled && is_branch(instruction->type)) {
+    branch_record(instruction_ip, state.jumpTaken, sim->total_clocks);
+  }
+
+  if (print_execution) {
+    print_executinon_change(sim, &result.timing);
+  }
+
+  if (trace_enabled) {
+    struct register_state state;
+    get_register_state(sim, &state);
+    trace_instruction(&sim->previous, &state, instruction->bsize,
+                      &result.timing);
+  }
+
+  if (print_execution || trace_enabled) {
+    update_state(sim);
+  }
 
   return result;
 }
@@ -2,6 +2,7 @@
 #define EXECUTE_H
 
 #include "clocks.h"
+#include "flags.h"
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -11,6 +12,42 @@ struct execute_result {
   struct instruction_timing timing;
 };
 
-struct execute_result execute_instruction(struct instruction *instruction);
+/* general registers, then ES, CS, SS and DS */
+#define SIM_REGISTER_COUNT 12
+
+struct register_state {
+  uint16_t regs[8];
+  uint16_t ip;
+  uint16_t flags;
+};
+
+struct sim86;
+
+/* print per-instruction state changes from execute_instruction() */
+extern bool print_execution;
+
+/*
+Applies instruction to machine state without printing or counting clocks.
+Returns false when instruction is not supported.
+*/
+bool apply_instruction(struct sim86 *sim, struct instruction *instruction,
+                       struct timing_state *state);
+
+/* Whether apply_instruction() can run instruction. */
+bool instruction_is_implemented(struct instruction *instruction);
+
+uint16_t mask_value(uint16_t value, uint16_t width);
+
+/* effective address of the memory operand with current registers, or 0 */
+uint16_t memory_operand_address(struct sim86 *sim,
+                                struct instruction *instruction);
+
+struct execute_result execute_instruction(struct sim86 *sim,
+                                          struct instruction *instruction);
+void get_register_state(struct sim86 *sim, struct register_state *state);
+void set_register_state(struct sim86 *sim, struct register_state *state);
+void set_register(struct sim86 *sim, struct register_access reg,
+                  uint16_t value);
+void print_registers_state(struct sim86 *sim);
 
 #endif // !EXECUTE_H
@@ -0,0 +1,194 @@
+#include "flags.h"
+#include "sim86.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined EAGER_FLAGS
+/*
+Reference for benchmarking lazy flags: every flag of the operation is
+computed right away, without going through flag_is_set().
+*/
+void flags_record(struct sim86 *sim, enum lazy_op op, uint16_t a, uint16_t b,
+                  uint16_t result, uint16_t width, uint8_t carry) {
+  uint16_t sign = width == 1 ? 0x80 : 0x8000;
+  uint32_t mask = width == 1 ? 0xff : 0xffff;
+  bool logic = op == LAZY_LOGIC;
+  bool adds = op == LAZY_ADD || op == LAZY_INC;
+  uint16_t overflow =
+      adds ? (a ^ result) & (b ^ result) : (a ^ b) & (a ^ result);
+  uint16_t flags = sim->flags.base & ~ARITHMETIC_FLAGS;
+
+  bool cf = op == LAZY_ADD   ? (uint32_t)a + b + carry > mask
+            : op == LAZY_SUB ? a < (uint32_t)b + carry
+                             : !logic && (sim->flags.base & CF);
+
+  flags |= cf ? CF : 0;
+  flags |= __builtin_parity(result & 0xff) ? 0 : PF;
+  flags |= !logic && ((a ^ b ^ result) & 0x10) ? AF : 0;
+  flags |= result == 0 ? ZF : 0;
+  flags |= result & sign ? SF : 0;
+  flags |= !logic && (overflow & sign) ? OF : 0;
+
+  sim->flags.op = LAZY_NONE;
+  sim->flags.base = flags;
+}
+#else
+void flags_record(struct sim86 *sim, enum lazy_op op, uint16_t a, uint16_t b,
+                  uint16_t result, uint16_t width, uint8_t carry) {
+  sim->flags.op = op;
+  sim->flags.width = width;
+  sim->flags.a = a;
+  sim->flags.b = b;
+  sim->flags.result = result;
+  sim->flags.carry = carry;
+}
+#endif
+
+uint16_t alu_add_carry(struct sim86 *sim, uint16_t a, uint16_t b,
+                       uint8_t carry, uint16_t width) {
+  uint16_t mask = width == 1 ? 0xff : 0xffff;
+  uint16_t result = (a + b + carry) & mask;
+  flags_record(sim, LAZY_ADD, a & mask, b & mask, result, width, carry);
+  return result;
+}
+
+uint16_t alu_sub_borrow(struct sim86 *sim, uint16_t a, uint16_t b,
+                        uint8_t borrow, uint16_t width) {
+  uint16_t mask = width == 1 ? 0xff : 0xffff;
+  uint16_t result = (a - b - borrow) & mask;
+  flags_record(sim, LAZY_SUB, a & mask, b & mask, result, width, borrow);
+  return result;
+}
+
+uint16_t alu_add(struct sim86 *sim, uint16_t a, uint16_t b, uint16_t width) {
+  return alu_add_carry(sim, a, b, 0, width);
+}
+
+uint16_t alu_adc(struct sim86 *sim, uint16_t a, uint16_t b, uint16_t width) {
+  return alu_add_carry(sim, a, b, flag_is_set(sim, CF), width);
+}
+
+uint16_t alu_sub(struct sim86 *sim, uint16_t a, uint16_t b, uint16_t width) {
+  return alu_sub_borrow(sim, a, b, 0, width);
+}
+
+uint16_t alu_sbb(struct sim86 *sim, uint16_t a, uint16_t b, uint16_t width) {
+  return alu_sub_borrow(sim, a, b, flag_is_set(sim, CF), width);
+}
+
+/* CF of pending operation moves to base, where INC and DEC leave it */
+void flags_keep_carry(struct sim86 *sim) {
+  bool carry = flag_is_set(sim, CF);
+  flag_assign(sim, CF, carry);
+}
+
+uint16_t alu_inc(struct sim86 *sim, uint16_t a, uint16_t width) {
+  uint16_t mask = width == 1 ? 0xff : 0xffff;
+  uint16_t result = (a + 1) & mask;
+  flags_keep_carry(sim);
+  flags_record(sim, LAZY_INC, a & mask, 1, result, width, 0);
+  return result;
+}
+
+uint16_t alu_dec(struct sim86 *sim, uint16_t a, uint16_t width) {
+  uint16_t mask = width == 1 ? 0xff : 0xffff;
+  uint16_t result = (a - 1) & mask;
+  flags_keep_carry(sim);
+  flags_record(sim, LAZY_DEC, a & mask, 1, result, width, 0);
+  return result;
+}
+
+uint16_t alu_logic(struct sim86 *sim, uint16_t result, uint16_t width) {
+  result &= width == 1 ? 0xff : 0xffff;
+  flags_record(sim, LAZY_LOGIC, 0, 0, result, width, 0);
+  return result;
+}
+
+uint16_t alu_and(struct sim86 *sim, uint16_t a, uint16_t b, uint16_t width) {
+  return alu_logic(sim, a & b, width);
+}
+
+uint16_t alu_or(struct sim86 *sim, uint16_t a, uint16_t b, uint16_t width) {
+  return alu_logic(sim, a | b, width);
+}
+
+uint16_t alu_xor(struct sim86 *sim, uint16_t a, uint16_t b, uint16_t width) {
+  return alu_logic(sim, a ^ b, width);
+}
+
+bool flag_is_set(struct sim86 *sim, enum op_flag flag) {
+  struct lazy_flags *f = &sim->flags;
+
+  if (f->op == LAZY_NONE) {
+    return f->base & flag;
+  }
+
+  uint16_t sign = f->width == 1 ? 0x80 : 0x8000;
+  uint32_t mask = f->width == 1 ? 0xff : 0xffff;
+  bool adds = f->op == LAZY_ADD || f->op == LAZY_INC;
+
+  switch (flag) {
+  case CF:
+    if (f->op == LAZY_ADD) {
+      return (uint32_t)f->a + f->b + f->carry > mask;
+    } else if (f->op == LAZY_SUB) {
+      return f->a < (uint32_t)f->b + f->carry;
+    }
+    return f->op == LAZY_LOGIC ? false : f->base & CF;
+
+  case PF:
+    return !__builtin_parity(f->result & 0xff);
+
+  case AF:
+    return f->op != LAZY_LOGIC && ((f->a ^ f->b ^ f->result) & 0x10);
+
+  case ZF:
+    return f->result == 0;
+
+  case SF:
+    return f->result & sign;
+
+  case OF:
+    if (f->op == LAZY_LOGIC) {
+      return false;
+    } else if (adds) {
+      return (f->a ^ f->result) & (f->b ^ f->result) & sign;
+    }
+    return (f->a ^ f->b) & (f->a ^ f->result) & sign;
+
+  default:
+    break;
+  }
+
+  return f->base & flag;
+}
+
+void flag_assign(struct sim86 *sim, enum op_flag flag, bool value) {
+  if (value) {
+    sim->flags.base |= flag;
+  } else {
+    sim->flags.base &= ~flag;
+  }
+}
+
+uint16_t flags_get(struct sim86 *sim) {
+  if (sim->flags.op == LAZY_NONE) {
+    return sim->flags.base;
+  }
+
+  uint16_t flags = sim->flags.base & ~ARITHMETIC_FLAGS;
+  enum op_flag all[] = {CF, PF, AF, ZF, SF, OF};
+
+  for (int i = 0; i < 6; ++i) {
+    if (flag_is_set(sim, all[i])) {
+      flags |= all[i];
+    }
+  }
+
+  return flags;
+}
+
+void flags_set(struct sim86 *sim, uint16_t flags) {
+  sim->flags.op = LAZY_NONE;
+  sim->flags.base = flags;
+}
@@ -0,0 +1,66 @@
+#ifndef FLAGS_H
+#define FLAGS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* bit positions match the 8086 FLAGS register */
+enum op_flag : uint16_t {
+  CF = 1 << 0,
+  PF = 1 << 2,
+  AF = 1 << 4,
+  ZF = 1 << 6,
+  SF = 1 << 7,
+  DF = 1 << 10, /* string instructions step down */
+  OF = 1 << 11,
+};
+
+#define ARITHMETIC_FLAGS (CF | PF | AF | ZF | SF | OF)
+
+enum lazy_op : uint8_t {
+  LAZY_NONE, /* flags are fully materialized in base */
+  LAZY_ADD,  /* ADD and ADC */
+  LAZY_SUB,  /* SUB, SBB, CMP and NEG */
+  LAZY_INC,  /* same as ADD and SUB, but CF stays as it is in base */
+  LAZY_DEC,
+  LAZY_LOGIC, /* AND, OR, XOR and TEST clear CF, OF and AF */
+};
+
+/*
+Last flag-producing operation. Flags are computed from it only when
+something reads them, so ALU instructions just store their operands.
+*/
+struct lazy_flags {
+  enum lazy_op op;
+  uint16_t width;
+  uint16_t a;
+  uint16_t b;
+  uint16_t result;
+  uint8_t carry; /* carry or borrow in of ADC and SBB */
+  uint16_t base; /* flags the operation does not produce */
+};
+
+struct sim86;
+
+uint16_t alu_add(struct sim86 *sim, uint16_t a, uint16_t b, uint16_t width);
+uint16_t alu_adc(struct sim86 *sim, uint16_t a, uint16_t b, uint16_t width);
+uint16_t alu_sub(struct sim86 *sim, uint16_t a, uint16_t b, uint16_t width);
+uint16_t alu_sbb(struct sim86 *sim, uint16_t a, uint16_t b, uint16_t width);
+uint16_t alu_inc(struct sim86 *sim, uint16_t a, uint16_t width);
+uint16_t alu_dec(struct sim86 *sim, uint16_t a, uint16_t width);
+/* Records flags of AND, OR, XOR or TEST result. */
+uint16_t alu_logic(struct sim86 *sim, uint16_t result, uint16_t width);
+uint16_t alu_and(struct sim86 *sim, uint16_t a, uint16_t b, uint16_t width);
+uint16_t alu_or(struct sim86 *sim, uint16_t a, uint16_t b, uint16_t width);
+uint16_t alu_xor(struct sim86 *sim, uint16_t a, uint16_t b, uint16_t width);
+
+/* Computes single flag from the pending operation. */
+bool flag_is_set(struct sim86 *sim, enum op_flag flag);
+
+/* Sets or clears flag that arithmetic leaves alone, such as DF. */
+void flag_assign(struct sim86 *sim, enum op_flag flag, bool value);
+
+uint16_t flags_get(struct sim86 *sim);
+void flags_set(struct sim86 *sim, uint16_t flags);
+
+#endif // FLAGS_H
@@ -0,0 +1,161 @@
+#include "generate.h"
+#include "decode.h"
+#include "instruction.h"
+#include "string_ops.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define DEFAULT_SEED 0x9E3779B97F4A7C15ull
+
+uint64_t rng_state = DEFAULT_SEED;
+
+uint8_t valid_opcodes[256];
+uint16_t valid_opcode_count = 0;
+
+void generate_seed(uint64_t seed) {
+  rng_state = seed ? seed : DEFAULT_SEED;
+}
+
+/* xorshift64, good enough to spread opcodes and operands */
+uint64_t rng_next() {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+/*
+Picks prefixes that make sense for instruction, in the order encoder emits
+them: segment override and lock need memory operand, repeat a string one.
+*/
+uint8_t generate_prefixes(uint8_t *out, bool memory, bool string) {
+  uint64_t r = rng_next();
+  uint8_t n = 0;
+
+  /* most instructions go without, as in real code */
+  if ((r & 7) != 0) {
+    return 0;
+  }
+
+  r >>= 3;
+
+  if (memory && (r & 3) == 0) {
+    out[n++] = 0xF0;
+  }
+
+  if (string && (r & 4)) {
+    out[n++] = (r & 8) ? 0xF3 : 0xF2;
+  }
+
+  if ((memory || string) && (r & 16)) {
+    out[n++] = 0x26 | ((r >> 5) & 3) << 3;
+  }
+
+  return n;
+}
+
+uint8_t generate_instruction(uint8_t *out) {
+  uint64_t r = rng_next();
+  uint8_t opcode = valid_opcodes[r % valid_opcode_count];
+  struct instruction_encoding enc = instructions[opcode];
+  uint8_t body[MAX_INSTRUCTION_SIZE];
+  uint8_t n = 0;
+
+  r >>= 16;
+  body[n++] = opcode;
+
+  uint8_t fields = enc.included_fields;
+
+  if (enc.size == WORD) {
+    uint8_t reg = (r >> 2) & 7;
+
+    if (enc.extended == EXTENDED) {
+      while (enc.types[reg] == INST_NOT_USED) {
+        reg = rng_next() & 7;
+      }
+
+      if ((enc.fields & EXT0_DATA) && reg != 0) {
+        enc.fields &= ~DATA;
+      }
+    } else if (enc.fields & SR) {
+      reg &= 3;
+    } else if (!(enc.fields & REG)) {
+      reg = 0;
+    }
+
+    fields = (r & 3) << 6 | reg << 3 | ((r >> 5) & 7);
+    if (!(enc.fields & RM)) {
+      fields &= 0x38;
+    }
+
+    body[n++] = fields;
+  }
+
+  r = rng_next();
+
+  if (enc.fields & RM) {
+    uint8_t mod = fields >> 6;
+    uint8_t rm = fields & 7;
+    int16_t disp = r;
+    r >>= 16;
+
+    if (mod == MOD_MEM8) {
+      disp = (int8_t)disp;
+      if (disp == 0 && rm != 0b110) {
+        disp = 1;
+      }
+
+      body[n++] = disp;
+    } else if (mod == MOD_MEM16) {
+      if (disp >= -128 && disp <= 127) {
+        disp += 0x100;
+      }
+
+      body[n++] = disp & 0xff;
+      body[n++] = disp >> 8;
+    } else if (mod == MOD_MEM && rm == 0b110) {
+      body[n++] = disp & 0xff;
+      body[n++] = disp >> 8;
+    }
+  }
+
+  bool is_imm_wide =
+      (enc.fields & DATA) && (enc.fields & F_W) && !(enc.fields & F_S);
+
+  if (is_imm_wide || (enc.fields & ADDR16)) {
+    body[n++] = r & 0xff;
+    body[n++] = (r >> 8) & 0xff;
+  } else if (enc.fields & (DATA | DATA8 | ADDR)) {
+    body[n++] = r & 0xff;
+  }
+
+  bool memory = (enc.fields & RM) && (fields >> 6) != MOD_REG;
+  uint8_t prefix_size = generate_prefixes(out, memory, is_string(enc.type));
+  memcpy(out + prefix_size, body, n);
+
+  return prefix_size + n;
+}
+
+size_t generate_instructions(uint8_t *out, size_t size, uint64_t max_count,
+                             uint64_t *count) {
+  if (valid_opcode_count == 0) {
+    for (uint16_t opcode = 0; opcode < 256; ++opcode) {
+      if (instructions[opcode].size != 0) {
+        valid_opcodes[valid_opcode_count++] = opcode;
+      }
+    }
+  }
+
+  size_t end = 0;
+  uint64_t generated = 0;
+
+  while (generated < max_count && end + MAX_INSTRUCTION_SIZE <= size) {
+    end += generate_instruction(out + end);
+    generated++;
+  }
+
+  *count = generated;
+  return end;
+}
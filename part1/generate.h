@@ -0,0 +1,19 @@
+#ifndef GENERATE_H
+#define GENERATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* seeds random instruction generator, zero picks default seed */
+void generate_seed(uint64_t seed);
+
+/*
+Fills out with random instructions valid for the decode table, at most
+max_count of them. Displacements use the shortest form so each instruction
+has a unique encoding. Returns number of bytes written, *count receives
+number of instructions.
+*/
+size_t generate_instructions(uint8_t *out, size_t size, uint64_t max_count,
+                             uint64_t *count);
+
+#endif // GENERATE_H
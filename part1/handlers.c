@@ -0,0 +1,270 @@
+#include "handlers.h"
+#include "branches.h"
+#include "execute.h"
+#include "flags.h"
+#include "instruction.h"
+#include "memory.h"
+#include "sim86.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+bool use_specialized_handlers = true;
+
+#define R_BX sim->regs[Reg_B - 1]
+#define R_BP sim->regs[Reg_BP - 1]
+#define R_SI sim->regs[Reg_SI - 1]
+#define R_DI sim->regs[Reg_DI - 1]
+
+/* register file viewed as bytes, low byte first (little endian host) */
+#define LOAD_R8(op)                                                            \
+  (((uint8_t *)sim->regs)[((op).register_.type - 1) * 2 + (op).register_.byte])
+#define LOAD_R16(op) (sim->regs[(op).register_.type - 1])
+#define STORE_R8(op, v) (LOAD_R8(op) = (v))
+#define STORE_R16(op, v) (LOAD_R16(op) = (v))
+
+#define LOAD_M8(addr) mem_read_byte(sim, addr)
+#define LOAD_M16(addr) mem_read_word(sim, addr)
+#define STORE_M8(addr, v) mem_save_byte(sim, addr, v)
+#define STORE_M16(addr, v) mem_save_word(sim, addr, v)
+
+#define IMM8(op) ((uint16_t)(op).immediate & 0xff)
+#define IMM16(op) ((uint16_t)(op).immediate)
+
+#define WIDTH_8 1
+#define WIDTH_16 2
+
+/* result of operation and whether it is written back to destination */
+#define ALU_MOV(w, a, b) (b)
+#define ALU_ADD(w, a, b) alu_add(sim, a, b, WIDTH_##w)
+#define ALU_SUB(w, a, b) alu_sub(sim, a, b, WIDTH_##w)
+#define ALU_CMP(w, a, b) alu_sub(sim, a, b, WIDTH_##w)
+#define ALU_ADC(w, a, b) alu_adc(sim, a, b, WIDTH_##w)
+#define ALU_SBB(w, a, b) alu_sbb(sim, a, b, WIDTH_##w)
+#define ALU_AND(w, a, b) alu_and(sim, a, b, WIDTH_##w)
+#define ALU_OR(w, a, b) alu_or(sim, a, b, WIDTH_##w)
+#define ALU_XOR(w, a, b) alu_xor(sim, a, b, WIDTH_##w)
+#define ALU_TEST(w, a, b) alu_and(sim, a, b, WIDTH_##w)
+
+#define WRITES_MOV 1
+#define WRITES_ADD 1
+#define WRITES_SUB 1
+#define WRITES_CMP 0
+#define WRITES_ADC 1
+#define WRITES_SBB 1
+#define WRITES_AND 1
+#define WRITES_OR 1
+#define WRITES_XOR 1
+#define WRITES_TEST 0
+
+// clang-format off
+#define ALU_OPS(X)                                                             \
+  X(MOV)                                                                       \
+  X(ADD)                                                                       \
+  X(SUB)                                                                       \
+  X(CMP)                                                                       \
+  X(ADC)                                                                       \
+  X(SBB)                                                                       \
+  X(AND)                                                                       \
+  X(OR)                                                                        \
+  X(XOR)                                                                       \
+  X(TEST)
+
+/* same order as enum effective_address_type */
+#define EA_MODES(X, ...)                                                       \
+  X(Direct, 0, __VA_ARGS__)                                                    \
+  X(BX_SI, R_BX + R_SI, __VA_ARGS__)                                           \
+  X(BX_DI, R_BX + R_DI, __VA_ARGS__)                                           \
+  X(BP_SI, R_BP + R_SI, __VA_ARGS__)                                           \
+  X(BP_DI, R_BP + R_DI, __VA_ARGS__)                                           \
+  X(SI, R_SI, __VA_ARGS__)                                                     \
+  X(DI, R_DI, __VA_ARGS__)                                                     \
+  X(BP, R_BP, __VA_ARGS__)                                                     \
+  X(BX, R_BX, __VA_ARGS__)
+
+#define DEFINE_REG_HANDLERS(op, w)                                             \
+  bool handle_##op##_r##w##_r(struct sim86 *sim, struct instruction *i) {     \
+    uint16_t r = ALU_##op(w, LOAD_R##w(i->operand[0]),                         \
+                          LOAD_R##w(i->operand[1]));                           \
+    if (WRITES_##op)                                                           \
+      STORE_R##w(i->operand[0], r);                                            \
+    return false;                                                              \
+  }                                                                            \
+                                                                               \
+  bool handle_##op##_r##w##_imm(struct sim86 *sim, struct instruction *i) {   \
+    uint16_t r = ALU_##op(w, LOAD_R##w(i->operand[0]),                         \
+                          IMM##w(i->operand[1]));                              \
+    if (WRITES_##op)                                                           \
+      STORE_R##w(i->operand[0], r);                                            \
+    return false;                                                              \
+  }
+
+#define DEFINE_MEM_HANDLERS(ea, base, op, w)                                   \
+  bool handle_##op##_r##w##_m_##ea(struct sim86 *sim,                         \
+                                   struct instruction *i) {                    \
+    uint16_t addr = (base) + i->operand[1].memory.displacement;                \
+    uint16_t r = ALU_##op(w, LOAD_R##w(i->operand[0]), LOAD_M##w(addr));       \
+    if (WRITES_##op)                                                           \
+      STORE_R##w(i->operand[0], r);                                            \
+    return false;                                                              \
+  }                                                                            \
+                                                                               \
+  bool handle_##op##_m##w##_##ea##_r(struct sim86 *sim,                       \
+                                     struct instruction *i) {                  \
+    uint16_t addr = (base) + i->operand[0].memory.displacement;                \
+    uint16_t r = ALU_##op(w, LOAD_M##w(addr), LOAD_R##w(i->operand[1]));       \
+    if (WRITES_##op)                                                           \
+      STORE_M##w(addr, r);                                                     \
+    return false;                                                              \
+  }                                                                            \
+                                                                               \
+  bool handle_##op##_m##w##_##ea##_imm(struct sim86 *sim,                     \
+                                       struct instruction *i) {                \
+    uint16_t addr = (base) + i->operand[0].memory.displacement;                \
+    uint16_t r = ALU_##op(w, LOAD_M##w(addr), IMM##w(i->operand[1]));          \
+    if (WRITES_##op)                                                           \
+      STORE_M##w(addr, r);                                                     \
+    return false;                                                              \
+  }
+
+#define DEFINE_OP_WIDTH(op, w)                                                 \
+  DEFINE_REG_HANDLERS(op, w)                                                   \
+  EA_MODES(DEFINE_MEM_HANDLERS, op, w)
+
+#define DEFINE_OP(op)                                                          \
+  DEFINE_OP_WIDTH(op, 8)                                                       \
+  DEFINE_OP_WIDTH(op, 16)
+
+ALU_OPS(DEFINE_OP)
+
+enum handler_op {
+#define HANDLER_OP(op) HANDLER_OP_##op,
+  ALU_OPS(HANDLER_OP)
+#undef HANDLER_OP
+  HANDLER_OP_COUNT,
+};
+
+enum handler_shape {
+  SHAPE_REG_REG,
+  SHAPE_REG_IMM,
+  SHAPE_REG_MEM,
+  SHAPE_MEM_REG = SHAPE_REG_MEM + 9,
+  SHAPE_MEM_IMM = SHAPE_MEM_REG + 9,
+  SHAPE_COUNT = SHAPE_MEM_IMM + 9,
+};
+
+#define WIDTH_INDEX_8 0
+#define WIDTH_INDEX_16 1
+
+#define REG_ENTRIES(op, w)                                                     \
+  [HANDLER_OP_##op][WIDTH_INDEX_##w][SHAPE_REG_REG] = handle_##op##_r##w##_r,  \
+  [HANDLER_OP_##op][WIDTH_INDEX_##w][SHAPE_REG_IMM] = handle_##op##_r##w##_imm,
+
+#define MEM_ENTRIES(ea, base, op, w)                                           \
+  [HANDLER_OP_##op][WIDTH_INDEX_##w]                                           \
+  [SHAPE_REG_MEM + EffectiveAddress_##ea] = handle_##op##_r##w##_m_##ea,       \
+  [HANDLER_OP_##op][WIDTH_INDEX_##w]                                           \
+  [SHAPE_MEM_REG + EffectiveAddress_##ea] = handle_##op##_m##w##_##ea##_r,     \
+  [HANDLER_OP_##op][WIDTH_INDEX_##w]                                           \
+  [SHAPE_MEM_IMM + EffectiveAddress_##ea] = handle_##op##_m##w##_##ea##_imm,
+
+#define OP_WIDTH_ENTRIES(op, w)                                                \
+  REG_ENTRIES(op, w)                                                           \
+  EA_MODES(MEM_ENTRIES, op, w)
+
+#define OP_ENTRIES(op)                                                         \
+  OP_WIDTH_ENTRIES(op, 8)                                                      \
+  OP_WIDTH_ENTRIES(op, 16)
+
+instruction_handler handler_table[HANDLER_OP_COUNT][2][SHAPE_COUNT] = {
+  ALU_OPS(OP_ENTRIES)
+};
+// clang-format on
+
+#define DEFINE_JUMP_HANDLER(name, condition)                                   \
+  bool handle_##name(struct sim86 *sim, struct instruction *i) {              \
+    if (condition) {                                                           \
+      sim->ip += i->operand[0].immediate;                                      \
+      return true;                                                             \
+    }                                                                          \
+    return false;                                                              \
+  }
+
+JUMP_CONDITIONS(DEFINE_JUMP_HANDLER)
+
+#define JUMP_ENTRY(name, condition) [INST_##name] = handle_##name,
+
+instruction_handler jump_handlers[INST_JCXZ + 1] = {
+    JUMP_CONDITIONS(JUMP_ENTRY)};
+
+int8_t get_handler_op(enum instruction_type type) {
+  switch (type) {
+  case INST_MOV:
+    return HANDLER_OP_MOV;
+  case INST_ADD:
+    return HANDLER_OP_ADD;
+  case INST_SUB:
+    return HANDLER_OP_SUB;
+  case INST_CMP:
+    return HANDLER_OP_CMP;
+  case INST_ADC:
+    return HANDLER_OP_ADC;
+  case INST_SBB:
+    return HANDLER_OP_SBB;
+  case INST_AND:
+    return HANDLER_OP_AND;
+  case INST_OR:
+    return HANDLER_OP_OR;
+  case INST_XOR:
+    return HANDLER_OP_XOR;
+  case INST_TEST:
+    return HANDLER_OP_TEST;
+  default:
+    return -1;
+  }
+}
+
+bool is_general_register(struct operand op) {
+  return op.type == Operand_Register && op.register_.type < Reg_ES;
+}
+
+instruction_handler select_handler(struct instruction *inst) {
+  if (!use_specialized_handlers) {
+    return NULL;
+  }
+
+  if (is_branch(inst->type)) {
+    return jump_handlers[inst->type];
+  }
+
+  int8_t op = get_handler_op(inst->type);
+  if (op < 0) {
+    return NULL;
+  }
+
+  struct operand dst = inst->operand[0];
+  struct operand src = inst->operand[1];
+  uint8_t width = inst->flags & F_W ? WIDTH_INDEX_16 : WIDTH_INDEX_8;
+  int shape = -1;
+
+  if (is_general_register(dst)) {
+    if (is_general_register(src)) {
+      shape = SHAPE_REG_REG;
+    } else if (src.type == Operand_Immediate) {
+      shape = SHAPE_REG_IMM;
+    } else if (src.type == Operand_Memory) {
+      shape = SHAPE_REG_MEM + src.memory.type;
+    }
+  } else if (dst.type == Operand_Memory) {
+    if (is_general_register(src)) {
+      shape = SHAPE_MEM_REG + dst.memory.type;
+    } else if (src.type == Operand_Immediate) {
+      shape = SHAPE_MEM_IMM + dst.memory.type;
+    }
+  }
+
+  if (shape < 0) {
+    return NULL;
+  }
+
+  return handler_table[op][width][shape];
+}
@@ -0,0 +1,16 @@
+#ifndef HANDLERS_H
+#define HANDLERS_H
+
+#include "instruction.h"
+#include <stdbool.h>
+
+/* when false icache leaves every instruction to the generic path */
+extern bool use_specialized_handlers;
+
+/*
+Picks handler specialized for instruction's operation, width and operand
+shape. Returns NULL when the generic path has to be used.
+*/
+instruction_handler select_handler(struct instruction *inst);
+
+#endif // HANDLERS_H
@@ -0,0 +1,85 @@
+#include "icache.h"
+#include "decode.h"
+#include "handlers.h"
+#include "instruction.h"
+#include "sim86.h"
+#include "timer.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+void icache_cover(struct icache *icache, uint16_t ip, uint8_t bsize,
+                  int8_t delta) {
+  for (uint8_t i = 0; i < bsize; ++i) {
+    icache->coverage[(uint16_t)(ip + i)] += delta;
+  }
+}
+
+struct instruction *icache_get(struct sim86 *sim, uint16_t ip) {
+  struct icache *icache = &sim->icache;
+  struct icache_entry *entry = &icache->entries[ip];
+
+  if (entry->valid) {
+    icache->stats.hits++;
+    return &entry->instruction;
+  }
+
+  uint64_t start = read_timer_ns();
+
+  entry->instruction = (struct instruction){0};
+  if (!decode_instruction(sim, ip, &entry->instruction)) {
+    return NULL;
+  }
+
+  /* only executed instructions need a handler, disassembly skips it */
+  entry->instruction.handler = select_handler(&entry->instruction);
+
+  icache->stats.decode_ns += read_timer_ns() - start;
+  icache->stats.misses++;
+
+  entry->valid = true;
+  icache_cover(icache, ip, entry->instruction.bsize, 1);
+
+  return &entry->instruction;
+}
+
+void icache_invalidate(struct sim86 *sim, uint16_t addr, uint32_t n) {
+  struct icache *icache = &sim->icache;
+
+  for (uint32_t i = 0; i < n; ++i) {
+    uint16_t byte = addr + i;
+    if (icache->coverage[byte] == 0) {
+      continue;
+    }
+
+    for (uint16_t back = 0; back < MAX_INSTRUCTION_SIZE; ++back) {
+      struct icache_entry *entry = &icache->entries[(uint16_t)(byte - back)];
+
+      if (entry->valid && back < entry->instruction.bsize) {
+        entry->valid = false;
+        icache_cover(icache, byte - back, entry->instruction.bsize, -1);
+        icache->stats.invalidations++;
+        icache->generation++;
+      }
+    }
+  }
+}
+
+void icache_print_stats(struct sim86 *sim) {
+  struct icache_stats *stats = &sim->icache.stats;
+  uint64_t lookups = stats->hits + stats->misses;
+  double hit_rate = lookups ? 100.0 * stats->hits / lookups : 0.0;
+  double avg_decode_ns =
+      stats->misses ? (double)stats->decode_ns / stats->misses : 0.0;
+
+  printf("\nDecode cache:\n");
+  printf("\thits: %llu (%.2f%%)\n", (unsigned long long)stats->hits,
+         hit_rate);
+  printf("\tmisses: %llu\n", (unsigned long long)stats->misses);
+  printf("\tinvalidations: %llu\n",
+         (unsigned long long)stats->invalidations);
+  printf("\tdecode time: %.1f us (%.1f ns per decode)\n",
+         stats->decode_ns / 1000.0, avg_decode_ns);
+  printf("\tdecode time saved: ~%.1f us\n",
+         stats->hits * avg_decode_ns / 1000.0);
+}
@@ -0,0 +1,48 @@
+#ifndef ICACHE_H
+#define ICACHE_H
+
+#include "instruction.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ICACHE_SIZE 65536
+
+struct sim86;
+
+struct icache_stats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t invalidations;
+  uint64_t decode_ns; /* host time spent decoding on misses */
+};
+
+struct icache_entry {
+  bool valid;
+  struct instruction instruction;
+};
+
+struct icache {
+  struct icache_entry entries[ICACHE_SIZE];
+
+  /*
+  Number of cached instructions covering each byte. Lets writes to plain
+  data skip the invalidation scan entirely.
+  */
+  uint8_t coverage[ICACHE_SIZE];
+
+  struct icache_stats stats;
+  uint64_t generation; /* bumped whenever cached code is invalidated */
+};
+
+/*
+Returns decoded instruction at given address, decoding it on first use.
+Returns NULL when nothing can be decoded at that address.
+*/
+struct instruction *icache_get(struct sim86 *sim, uint16_t ip);
+
+/* Drops every cached instruction that overlaps [addr, addr + n). */
+void icache_invalidate(struct sim86 *sim, uint16_t addr, uint32_t n);
+
+void icache_print_stats(struct sim86 *sim);
+
+#endif // ICACHE_H
@@ -1,6 +1,7 @@
 #if !defined INST_H
 #define INST_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 enum instruction_flag : uint16_t {
@@ -18,6 +19,9 @@ enum instruction_flag : uint16_t {
   DATA8 = 1 << 10,
   ADDR = 1 << 11,
   RM_ALWAYS_W = 1 << 12,
+  EXT0_DATA = 1 << 13, /* DATA only for extension 000, TEST in its group */
+  COUNT = 1 << 14,     /* shift count operand, CL with F_V and 1 without */
+  ADDR16 = 1 << 15,    /* 16-bit relative address of near CALL */
 };
 
 enum instruction_type : uint8_t {
@@ -49,9 +53,41 @@ enum instruction_type : uint8_t {
   INST_JCXZ,
   INST_PUSH,
   INST_POP,
+  INST_CALL,
+  INST_RET,
   INST_XCHG,
   INST_IN,
   INST_OUT,
+  INST_MOVS,
+  INST_CMPS,
+  INST_SCAS,
+  INST_LODS,
+  INST_STOS,
+  INST_CLD,
+  INST_STD,
+  INST_ADC,
+  INST_SBB,
+  INST_AND,
+  INST_OR,
+  INST_XOR,
+  INST_TEST,
+  INST_INC,
+  INST_DEC,
+  INST_NEG,
+  INST_NOT,
+  INST_MUL,
+  INST_IMUL,
+  INST_DIV,
+  INST_IDIV,
+  INST_ROL,
+  INST_ROR,
+  INST_RCL,
+  INST_RCR,
+  INST_SHL,
+  INST_SHR,
+  INST_SAR,
+
+  INST_COUNT,
 };
 
 enum operand_type {
@@ -119,11 +155,35 @@ struct operand {
   };
 };
 
+enum instruction_prefix : uint8_t {
+  PREFIX_LOCK = 1 << 0,
+  PREFIX_REP = 1 << 1,     /* F3, REPE for CMPS and SCAS */
+  PREFIX_REPNE = 1 << 2,   /* F2 */
+  PREFIX_SEGMENT = 1 << 3, /* segment override, register in segment */
+};
+
+/* at most one prefix of each group: lock, repeat and segment */
+#define MAX_PREFIXES 3
+#define MAX_INSTRUCTION_SIZE (6 + MAX_PREFIXES)
+
+struct instruction;
+struct sim86;
+
+/*
+Executes instruction specialized for its operand shape. Returns true when
+a jump was taken.
+*/
+typedef bool (*instruction_handler)(struct sim86 *, struct instruction *);
+
 struct instruction {
   enum instruction_type type;
   enum instruction_flag flags;
   struct operand operand[2];
-  uint8_t bsize; /* size of instruction in bytes */
+  uint8_t prefixes;
+  enum register_type segment; /* override, Reg_None without one */
+  uint8_t opcode; /* byte after prefixes, selects encoding to encode back */
+  uint8_t bsize;  /* size of instruction in bytes, prefixes included */
+  instruction_handler handler; /* chosen by icache, NULL if none fits */
 };
 
 #endif
@@ -0,0 +1,166 @@
+#include "io.h"
+#include "sim86.h"
+#include "watchdog.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+uint64_t pit_ticks(struct sim86 *sim) {
+  return sim->total_clocks / PIT_CLOCK_DIVISOR;
+}
+
+/* Count right now, from reload down to 1, 65536 reads as 0. */
+uint16_t pit_count(struct sim86 *sim) {
+  struct pit_state *pit = &sim->io.pit;
+  uint32_t period = pit->reload ? pit->reload : 65536;
+  return period - (pit_ticks(sim) - pit->start) % period;
+}
+
+/* before any control word, low then high byte as BIOS programs it */
+uint8_t pit_access(struct pit_state *pit) {
+  return pit->access ? pit->access : 3;
+}
+
+uint8_t pit_read(struct sim86 *sim, uint16_t port) {
+  struct pit_state *pit = &sim->io.pit;
+  uint16_t count = pit->latched ? pit->latch : pit_count(sim);
+  uint8_t access = pit_access(pit);
+  bool high = access == 2 || (access == 3 && pit->read_high);
+
+  /* latch holds until all its bytes are read */
+  if (access == 3) {
+    pit->read_high = !pit->read_high;
+  }
+
+  if (access != 3 || !pit->read_high) {
+    pit->latched = false;
+  }
+
+  return high ? count >> 8 : count;
+}
+
+void pit_write(struct sim86 *sim, uint16_t port, uint8_t value) {
+  struct pit_state *pit = &sim->io.pit;
+
+  switch (pit_access(pit)) {
+  case 1:
+    pit->reload = (pit->reload & 0xff00) | value;
+    break;
+
+  case 2:
+    pit->reload = (pit->reload & 0x00ff) | value << 8;
+    break;
+
+  default:
+    if (!pit->write_high) {
+      pit->low = value;
+      pit->write_high = true;
+      return;
+    }
+
+    pit->reload = pit->low | value << 8;
+    pit->write_high = false;
+    break;
+  }
+
+  /* new count starts as soon as it is complete */
+  pit->start = pit_ticks(sim);
+}
+
+void pit_control(struct sim86 *sim, uint16_t port, uint8_t value) {
+  struct pit_state *pit = &sim->io.pit;
+  uint8_t access = value >> 4 & 3;
+
+  /* counters 1 and 2 are not wired to anything */
+  if (value >> 6 != 0) {
+    return;
+  }
+
+  if (access == 0) {
+    if (!pit->latched) {
+      pit->latch = pit_count(sim);
+      pit->latched = true;
+    }
+
+    return;
+  }
+
+  pit->access = access;
+  pit->write_high = false;
+  pit->read_high = false;
+  pit->latched = false;
+}
+
+/* reading first byte takes a snapshot, so a multi-word read is consistent */
+uint8_t clocks_read(struct sim86 *sim, uint16_t port) {
+  if (port == IO_CLOCKS) {
+    sim->io.clocks = sim->total_clocks;
+  }
+
+  return sim->io.clocks >> (port - IO_CLOCKS) * 8;
+}
+
+void debug_char_write(struct sim86 *sim, uint16_t port, uint8_t value) {
+  putchar(value);
+}
+
+/* word comes as low byte at IO_DEBUG_NUMBER and high byte right after */
+void debug_number_write(struct sim86 *sim, uint16_t port, uint8_t value) {
+  if (port == IO_DEBUG_NUMBER) {
+    sim->io.number_low = value;
+    return;
+  }
+
+  printf("%u", (unsigned)(sim->io.number_low | value << 8));
+}
+
+struct io_port io_ports[IO_PORT_COUNT] = {
+    [IO_PIT_COUNTER] = {pit_read, pit_write},
+    [IO_PIT_CONTROL] = {NULL, pit_control},
+    [IO_CLOCKS ... IO_CLOCKS + 7] = {clocks_read, NULL},
+    [IO_DEBUG_CHAR] = {NULL, debug_char_write},
+    [IO_DEBUG_NUMBER ... IO_DEBUG_NUMBER + 1] = {NULL, debug_number_write},
+};
+
+void io_attach(uint16_t port, uint32_t count, io_read read, io_write write) {
+  for (uint32_t i = 0; i < count && port + i < IO_PORT_COUNT; ++i) {
+    io_ports[port + i] = (struct io_port){read, write};
+  }
+}
+
+uint8_t io_read_byte(struct sim86 *sim, uint16_t port) {
+  io_read read = io_ports[port].read;
+  if (read == NULL) {
+    return 0xff;
+  }
+
+  /* device value depends on time, so loops polling it are not hangs */
+  if (watchdog.detect_hangs) {
+    watchdog_forget(sim);
+  }
+
+  return read(sim, port);
+}
+
+void io_write_byte(struct sim86 *sim, uint16_t port, uint8_t value) {
+  io_write write = io_ports[port].write;
+  if (write != NULL) {
+    write(sim, port, value);
+  }
+}
+
+uint16_t io_in(struct sim86 *sim, uint16_t port, uint16_t width) {
+  uint16_t value = io_read_byte(sim, port);
+  if (width == 2) {
+    value |= io_read_byte(sim, port + 1) << 8;
+  }
+
+  return value;
+}
+
+void io_out(struct sim86 *sim, uint16_t port, uint16_t value, uint16_t width) {
+  io_write_byte(sim, port, value);
+  if (width == 2) {
+    io_write_byte(sim, port + 1, value >> 8);
+  }
+}
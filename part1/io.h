@@ -0,0 +1,67 @@
+#ifndef IO_H
+#define IO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define IO_PORT_COUNT 65536
+
+/* ports of built-in devices */
+#define IO_PIT_COUNTER 0x40  /* count of PIT counter 0 */
+#define IO_PIT_CONTROL 0x43  /* PIT control word */
+#define IO_CLOCKS 0xE0       /* 8 bytes of total_clocks, first one latches */
+#define IO_DEBUG_CHAR 0xE9   /* byte written goes to stdout as is */
+#define IO_DEBUG_NUMBER 0xEA /* word written goes to stdout in decimal */
+
+/* PIT input clock is CPU clock divided by 4, 1.19 MHz on a 4.77 MHz PC */
+#define PIT_CLOCK_DIVISOR 4
+
+struct sim86;
+
+/* Device side of one port, word accesses are two byte accesses. */
+typedef uint8_t (*io_read)(struct sim86 *, uint16_t port);
+typedef void (*io_write)(struct sim86 *, uint16_t port, uint8_t value);
+
+struct io_port {
+  io_read read;   /* NULL reads 0xFF, nothing drives the bus */
+  io_write write; /* NULL drops the byte */
+};
+
+/*
+Counter 0 of an 8253. Every mode counts down once per tick from the reload
+value and starts over when it passes 1, as mode 2 does. Reload 0 means
+65536.
+*/
+struct pit_state {
+  uint16_t reload;
+  uint64_t start;  /* tick the count last started at */
+  uint8_t access;  /* 1 low byte, 2 high byte, 3 low then high */
+  bool write_high; /* low byte of reload written, high one comes next */
+  bool read_high;  /* low byte of count read, high one comes next */
+  bool latched;
+  uint16_t latch;
+  uint8_t low; /* low byte of reload being written */
+};
+
+/* guest visible device state, part of the machine */
+struct io_state {
+  uint64_t clocks; /* total_clocks latched by last read of IO_CLOCKS */
+  struct pit_state pit;
+  uint8_t number_low; /* low byte of word written to IO_DEBUG_NUMBER */
+};
+
+/*
+Per port dispatch table, shared by all machines. Built-in devices are in
+it from the start, io_attach() adds more before any machine runs.
+*/
+extern struct io_port io_ports[IO_PORT_COUNT];
+
+/* Puts device on ports [port, port + count). */
+void io_attach(uint16_t port, uint32_t count, io_read read, io_write write);
+
+/* Reads byte or word, width is 1 or 2. */
+uint16_t io_in(struct sim86 *sim, uint16_t port, uint16_t width);
+
+void io_out(struct sim86 *sim, uint16_t port, uint16_t value, uint16_t width);
+
+#endif // IO_H
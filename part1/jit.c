@@ -0,0 +1,408 @@
+#include "jit.h"
+#include "block.h"
+#include "clocks.h"
+#include "execute.h"
+#include "flags.h"
+#include "instruction.h"
+#include "sim86.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#endif
+
+/* longest code one guest instruction compiles to, epilogue included */
+#define JIT_MAX_INSTRUCTION_CODE 128
+
+bool jit_enabled = false;
+uint32_t jit_threshold = JIT_DEFAULT_THRESHOLD;
+
+/*
+Runs instruction compiled code does not translate, the same way the block
+engine does. Returns true when it wrote over code, so the rest of the block
+is stale.
+*/
+bool jit_step(struct sim86 *sim, struct instruction *instruction) {
+  struct timing_state state = {0};
+
+  if (memory_transfers(instruction) != 0) {
+    state.address = memory_operand_address(sim, instruction);
+    sim->total_clocks += bus_penalty(&bus_model, instruction, &state);
+  }
+
+  apply_instruction(sim, instruction, &state);
+  return sim->blocks->generation != sim->icache.generation;
+}
+
+#if defined(__x86_64__)
+
+/* host registers, numbered as in ModRM */
+enum jit_register { JIT_EAX = 0, JIT_ECX = 1, JIT_EDX = 2 };
+
+/* host ALU opcodes of "op r/m32, r32" form */
+enum jit_alu : uint8_t {
+  JIT_ADD = 0x01,
+  JIT_OR = 0x09,
+  JIT_AND = 0x21,
+  JIT_SUB = 0x29,
+  JIT_XOR = 0x31,
+};
+
+struct jit_emitter {
+  uint8_t *code;
+  uint32_t size;
+};
+
+#define SIM_OFFSET(field) ((uint32_t)offsetof(struct sim86, field))
+
+void emit_u8(struct jit_emitter *e, uint8_t value) {
+  e->code[e->size++] = value;
+}
+
+void emit_u16(struct jit_emitter *e, uint16_t value) {
+  memcpy(e->code + e->size, &value, sizeof(value));
+  e->size += sizeof(value);
+}
+
+void emit_u32(struct jit_emitter *e, uint32_t value) {
+  memcpy(e->code + e->size, &value, sizeof(value));
+  e->size += sizeof(value);
+}
+
+void emit_u64(struct jit_emitter *e, uint64_t value) {
+  memcpy(e->code + e->size, &value, sizeof(value));
+  e->size += sizeof(value);
+}
+
+/* ModRM addressing [rbx + disp32], rbx holds sim */
+void emit_sim_operand(struct jit_emitter *e, uint8_t reg, uint32_t offset) {
+  emit_u8(e, 0x80 | reg << 3 | 3);
+  emit_u32(e, offset);
+}
+
+/* movzx reg, byte/word [sim + offset] */
+void emit_load(struct jit_emitter *e, enum jit_register reg, uint32_t offset,
+               uint16_t width) {
+  emit_u8(e, 0x0F);
+  emit_u8(e, width == 1 ? 0xB6 : 0xB7);
+  emit_sim_operand(e, reg, offset);
+}
+
+/* mov byte/word [sim + offset], reg */
+void emit_store(struct jit_emitter *e, enum jit_register reg, uint32_t offset,
+                uint16_t width) {
+  if (width == 2) {
+    emit_u8(e, 0x66);
+  }
+
+  emit_u8(e, width == 1 ? 0x88 : 0x89);
+  emit_sim_operand(e, reg, offset);
+}
+
+void emit_store_imm8(struct jit_emitter *e, uint32_t offset, uint8_t value) {
+  emit_u8(e, 0xC6);
+  emit_sim_operand(e, 0, offset);
+  emit_u8(e, value);
+}
+
+void emit_store_imm16(struct jit_emitter *e, uint32_t offset, uint16_t value) {
+  emit_u8(e, 0x66);
+  emit_u8(e, 0xC7);
+  emit_sim_operand(e, 0, offset);
+  emit_u16(e, value);
+}
+
+/* mov reg, imm32 */
+void emit_mov_imm(struct jit_emitter *e, enum jit_register reg,
+                  uint32_t value) {
+  emit_u8(e, 0xB8 + reg);
+  emit_u32(e, value);
+}
+
+/* op eax, ecx */
+void emit_alu(struct jit_emitter *e, enum jit_alu op) {
+  emit_u8(e, op);
+  emit_u8(e, 0xC0 | JIT_ECX << 3 | JIT_EAX);
+}
+
+/* movzx eax, al/ax, result wraps at width like in the ALU functions */
+void emit_mask(struct jit_emitter *e, uint16_t width) {
+  emit_u8(e, 0x0F);
+  emit_u8(e, width == 1 ? 0xB6 : 0xB7);
+  emit_u8(e, 0xC0);
+}
+
+void emit_add_clocks(struct jit_emitter *e, uint32_t clocks) {
+  if (clocks == 0) {
+    return;
+  }
+
+  /* add qword [sim + total_clocks], imm32 */
+  emit_u8(e, 0x48);
+  emit_u8(e, 0x81);
+  emit_sim_operand(e, 0, SIM_OFFSET(total_clocks));
+  emit_u32(e, clocks);
+}
+
+/* mov eax, count; pop rbx; ret */
+void emit_return(struct jit_emitter *e, uint32_t count) {
+  emit_mov_imm(e, JIT_EAX, count);
+  emit_u8(e, 0x5B);
+  emit_u8(e, 0xC3);
+}
+
+/* same fields flags_record() stores: a in edx, b in ecx, result in eax */
+void emit_flags(struct jit_emitter *e, enum lazy_op op, uint16_t width) {
+  emit_store_imm8(e, SIM_OFFSET(flags.op), op);
+  emit_store_imm16(e, SIM_OFFSET(flags.width), width);
+
+  if (op == LAZY_LOGIC) {
+    emit_store_imm16(e, SIM_OFFSET(flags.a), 0);
+    emit_store_imm16(e, SIM_OFFSET(flags.b), 0);
+  } else {
+    emit_store(e, JIT_EDX, SIM_OFFSET(flags.a), 2);
+    emit_store(e, JIT_ECX, SIM_OFFSET(flags.b), 2);
+  }
+
+  emit_store(e, JIT_EAX, SIM_OFFSET(flags.result), 2);
+  emit_store_imm8(e, SIM_OFFSET(flags.carry), 0);
+}
+
+uint32_t jit_register_offset(struct register_access reg) {
+  return SIM_OFFSET(regs) + (reg.type - 1) * 2 + (reg.byte == RegByte_High);
+}
+
+bool jit_is_register(struct operand *op, uint16_t width) {
+  return op->type == Operand_Register && op->register_.type >= Reg_A &&
+         op->register_.type <= Reg_DI &&
+         (op->register_.byte == RegByte_All) == (width == 2);
+}
+
+/* Whether instruction is translated rather than called back. */
+bool jit_can_translate(struct instruction *instruction) {
+  uint16_t width = instruction->flags & F_W ? 2 : 1;
+  struct operand *source = &instruction->operand[1];
+
+  if (!jit_is_register(&instruction->operand[0], width)) {
+    return false;
+  }
+
+  switch (instruction->type) {
+  case INST_MOV:
+    return jit_is_register(source, width) ||
+           source->type == Operand_Immediate;
+
+#if !defined EAGER_FLAGS
+  /* eager reference mode materializes flags in flags_record() */
+  case INST_ADD:
+  case INST_SUB:
+  case INST_CMP:
+  case INST_AND:
+  case INST_OR:
+  case INST_XOR:
+  case INST_TEST:
+    return jit_is_register(source, width) ||
+           source->type == Operand_Immediate;
+
+  case INST_NEG:
+#endif
+  case INST_NOT:
+    return source->type == Operand_None;
+
+  default:
+    return false;
+  }
+}
+
+void jit_translate(struct jit_emitter *e, struct instruction *instruction) {
+  uint16_t width = instruction->flags & F_W ? 2 : 1;
+  uint16_t mask = width == 1 ? 0xff : 0xffff;
+  uint32_t destination =
+      jit_register_offset(instruction->operand[0].register_);
+  struct operand *source = &instruction->operand[1];
+
+  if (source->type == Operand_Register) {
+    emit_load(e, JIT_ECX, jit_register_offset(source->register_), width);
+  } else if (source->type == Operand_Immediate) {
+    emit_mov_imm(e, JIT_ECX, (uint16_t)source->immediate & mask);
+  }
+
+  if (instruction->type == INST_MOV) {
+    emit_store(e, JIT_ECX, destination, width);
+    return;
+  }
+
+  if (instruction->type == INST_NEG) {
+    /* NEG is SUB from zero, operand is its b */
+    emit_load(e, JIT_ECX, destination, width);
+    emit_mov_imm(e, JIT_EAX, 0);
+  } else {
+    emit_load(e, JIT_EAX, destination, width);
+  }
+
+  /* mov edx, eax keeps a for the flags */
+  emit_u8(e, 0x89);
+  emit_u8(e, 0xC0 | JIT_EAX << 3 | JIT_EDX);
+
+  enum lazy_op op = LAZY_LOGIC;
+  bool writes = true;
+
+  switch (instruction->type) {
+  case INST_NOT:
+    /* not eax, flags stay */
+    emit_u8(e, 0xF7);
+    emit_u8(e, 0xD0);
+    emit_store(e, JIT_EAX, destination, width);
+    return;
+
+  case INST_ADD:
+    emit_alu(e, JIT_ADD);
+    op = LAZY_ADD;
+    break;
+
+  case INST_CMP:
+    writes = false;
+    /* fallthrough */
+  case INST_SUB:
+  case INST_NEG:
+    emit_alu(e, JIT_SUB);
+    op = LAZY_SUB;
+    break;
+
+  case INST_TEST:
+    writes = false;
+    /* fallthrough */
+  case INST_AND:
+    emit_alu(e, JIT_AND);
+    break;
+
+  case INST_OR:
+    emit_alu(e, JIT_OR);
+    break;
+
+  case INST_XOR:
+    emit_alu(e, JIT_XOR);
+    break;
+
+  default:
+    break;
+  }
+
+  emit_mask(e, width);
+  emit_flags(e, op, width);
+
+  if (writes) {
+    emit_store(e, JIT_EAX, destination, width);
+  }
+}
+
+/* Calls jit_step(), leaving with clocks counted so far when code changed. */
+void jit_call_step(struct jit_emitter *e, struct instruction *instruction,
+                   uint16_t ip, uint32_t done, uint32_t clocks) {
+  /* apply_instruction() moves ip past the instruction itself */
+  emit_store_imm16(e, SIM_OFFSET(ip), ip);
+
+  /* mov rdi, rbx; mov rsi, instruction; mov rax, jit_step; call rax */
+  emit_u8(e, 0x48);
+  emit_u8(e, 0x89);
+  emit_u8(e, 0xDF);
+  emit_u8(e, 0x48);
+  emit_u8(e, 0xBE);
+  emit_u64(e, (uint64_t)(uintptr_t)instruction);
+  emit_u8(e, 0x48);
+  emit_u8(e, 0xB8);
+  emit_u64(e, (uint64_t)(uintptr_t)jit_step);
+  emit_u8(e, 0xFF);
+  emit_u8(e, 0xD0);
+
+  /* test al, al; jz over the early return */
+  struct jit_emitter exit = {.code = e->code + e->size + 4};
+  emit_add_clocks(&exit, clocks);
+  emit_return(&exit, done);
+
+  emit_u8(e, 0x84);
+  emit_u8(e, 0xC0);
+  emit_u8(e, 0x74);
+  emit_u8(e, exit.size);
+  e->size += exit.size;
+}
+
+bool jit_compile(struct block_cache *cache, struct block *block) {
+  uint16_t body = block->count - block->ends_with_branch;
+  if (body == 0) {
+    return false;
+  }
+
+  if (cache->code == NULL && !cache->code_unavailable) {
+    void *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (code == MAP_FAILED) {
+      /* host does not allow executable memory, keep interpreting */
+      cache->code_unavailable = true;
+    } else {
+      cache->code = code;
+    }
+  }
+
+  uint32_t needed = (body + 1) * JIT_MAX_INSTRUCTION_CODE;
+  if (cache->code == NULL || cache->code_used + needed > JIT_CODE_SIZE) {
+    return false;
+  }
+
+  struct jit_emitter e = {.code = cache->code + cache->code_used};
+  uint16_t ip = block->start;
+  uint32_t clocks = 0;
+
+  /* push rbx; mov rbx, rdi */
+  emit_u8(&e, 0x53);
+  emit_u8(&e, 0x48);
+  emit_u8(&e, 0x89);
+  emit_u8(&e, 0xFB);
+
+  for (uint16_t i = 0; i < body; ++i) {
+    struct instruction *instruction = &block->instructions[i];
+    clocks += block->clocks[i];
+
+    if (jit_can_translate(instruction)) {
+      jit_translate(&e, instruction);
+    } else {
+      jit_call_step(&e, instruction, ip, i + 1, clocks);
+    }
+
+    ip += instruction->bsize;
+  }
+
+  emit_store_imm16(&e, SIM_OFFSET(ip), ip);
+  emit_add_clocks(&e, clocks);
+  emit_return(&e, body);
+
+  block->native = (block_code)(void *)(cache->code + cache->code_used);
+  cache->code_used += e.size;
+  cache->stats.compiled++;
+  return true;
+}
+
+void jit_reset(struct block_cache *cache) { cache->code_used = 0; }
+
+void jit_free(struct block_cache *cache) {
+  if (cache->code != NULL) {
+    munmap(cache->code, JIT_CODE_SIZE);
+    cache->code = NULL;
+  }
+}
+
+#else
+
+bool jit_compile(struct block_cache *cache, struct block *block) {
+  return false;
+}
+
+void jit_reset(struct block_cache *cache) {}
+
+void jit_free(struct block_cache *cache) {}
+
+#endif
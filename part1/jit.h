@@ -0,0 +1,36 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define JIT_DEFAULT_THRESHOLD 16
+#define JIT_CODE_SIZE (1 << 20)
+
+struct block;
+struct block_cache;
+struct sim86;
+
+/*
+Translator of hot blocks into x86-64 machine code. Compiled code runs body
+of a block, everything up to its terminating branch, with guest registers
+and lazy flags kept in struct sim86 and clocks added inline. Register to
+register and immediate MOV, ALU, NEG and NOT are translated, every other
+instruction is a call back into apply_instruction(). On other hosts
+nothing is compiled and blocks run as before.
+*/
+
+extern bool jit_enabled;
+
+/* runs of a block before it is compiled */
+extern uint32_t jit_threshold;
+
+/* Compiles body of block into cache's code buffer, false when it cannot. */
+bool jit_compile(struct block_cache *cache, struct block *block);
+
+/* Drops all compiled code, blocks it belonged to are flushed with it. */
+void jit_reset(struct block_cache *cache);
+
+void jit_free(struct block_cache *cache);
+
+#endif // JIT_H
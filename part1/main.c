@@ -5,19 +5,521 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "clocks.c"
+#include "batch.h"
+#include "biu.h"
+#include "block.h"
+#include "branches.h"
+#include "cache.h"
+#include "callgraph.h"
+#include "cfg.h"
 #include "clocks.h"
-#include "decode.c"
-#include "display.c"
-#include "execute.c"
+#include "decode.h"
+#include "display.h"
 #include "execute.h"
-#include "memory.c"
+#include "flags.h"
+#include "handlers.h"
+#include "icache.h"
+#include "jit.h"
 #include "memory.h"
+#include "profile.h"
+#include "sim86.h"
+#include "snapshot.h"
+#include "timer.h"
+#include "timing_model.h"
+#include "trace.h"
+#include "watchdog.h"
+
+void print_bench_report(struct sim86 *sim, uint64_t instructions,
+                        uint64_t elapsed_ns) {
+  double seconds = elapsed_ns / 1e9;
+
+  printf("\nBenchmark:\n");
+  printf("\tinstructions: %llu\n", (unsigned long long)instructions);
+  printf("\thost time: %llu ns\n", (unsigned long long)elapsed_ns);
+  printf("\tsimulated MIPS: %.2f\n",
+         seconds > 0 ? instructions / seconds / 1e6 : 0.0);
+  printf("\ttotal clocks: %llu\n", (unsigned long long)sim->total_clocks);
+  printf("\tsimulated speed: %.2f MHz\n",
+         seconds > 0 ? sim->total_clocks / seconds / 1e6 : 0.0);
+}
+
+bool read_delta_file(char *path, struct mem_delta *delta) {
+  FILE *fd = fopen(path, "rb");
+  if (fd == NULL) {
+    fprintf(stderr, "Cannot open file \"%s\", errno = %d\n", path, errno);
+    return false;
+  }
+
+  bool ok = mem_delta_read(fd, delta);
+  fclose(fd);
+
+  if (!ok) {
+    fprintf(stderr, "\"%s\" is not a sim86 delta dump.\n", path);
+  }
+
+  return ok;
+}
+
+void write_delta_file(struct sim86 *sim, char *path) {
+  struct mem_delta delta;
+  mem_delta_capture(sim, &delta);
+
+  FILE *fd = fopen(path, "wb");
+  if (fd == NULL) {
+    fprintf(stderr, "Cannot open file \"%s\", errno = %d\n", path, errno);
+  } else {
+    mem_delta_write(fd, &delta);
+    fclose(fd);
+  }
+
+  mem_delta_free(&delta);
+}
+
+int diff_delta_files(char *path_a, char *path_b) {
+  struct mem_delta a, b;
+  if (!read_delta_file(path_a, &a) || !read_delta_file(path_b, &b)) {
+    return 1;
+  }
+
+  size_t differences = mem_delta_diff(&a, &b, stdout);
+  printf("%zu bytes differ\n", differences);
+
+  mem_delta_free(&a);
+  mem_delta_free(&b);
+  return differences != 0;
+}
+
+#define DISASM_BATCH 256
+#define DISASM_CHUNK_SIZE (1 << 20)
+
+/* optional columns in front of disassembled instructions */
+bool show_address = false;
+bool show_bytes = false;
+
+/*
+Disassembles whole instructions of code placed at address. Returns bytes
+consumed, trailing bytes of an incomplete instruction are left. Jump targets
+found in cfg get labels, cfg may be NULL.
+*/
+size_t disassemble_code(struct text_writer *writer, const uint8_t *code,
+                        size_t size, uint32_t address, struct cfg *cfg) {
+  struct instruction decoded[DISASM_BATCH];
+  size_t offset = 0;
+
+  for (;;) {
+    size_t used = 0;
+    size_t count = decode_range(code + offset, size - offset, decoded,
+                                DISASM_BATCH, &used);
+    if (count == 0) {
+      break;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+      struct instruction *inst = &decoded[i];
+      uint16_t at = address + offset;
+      char *line = writer_reserve(writer, 48 + MAX_FORMATTED_SIZE);
+      char *end = line;
+
+      if (cfg != NULL && cfg->labeled[at]) {
+        end = format_label(end, at);
+        end = format_string(end, ":\n");
+      }
+
+      if (show_address) {
+        end = format_hex(end, address + offset, 8);
+        end = format_string(end, "  ");
+      }
+
+      if (show_bytes) {
+        for (uint8_t b = 0; b < MAX_INSTRUCTION_SIZE; ++b) {
+          if (b < inst->bsize) {
+            end = format_hex(end, code[offset + b], 2);
+          } else {
+            end = format_string(end, "  ");
+          }
+        }
+
+        end = format_string(end, "  ");
+      }
+
+      uint16_t target = at + inst->bsize + inst->operand[0].immediate;
+
+      if (cfg != NULL && (is_branch(inst->type) || is_direct_call(inst)) &&
+          cfg->labeled[target]) {
+        end += format_branch(inst, target, end);
+      } else {
+        end += format_instruction(inst, end);
+      }
+
+      *end++ = '\n';
+
+      writer_commit(writer, end - line);
+      offset += inst->bsize;
+    }
+  }
+
+  return offset;
+}
+
+/*
+Disassembles instruction cut off by end of code as if zeros followed it, as
+the simulator would run it. Code must hold MAX_INSTRUCTION_SIZE bytes with
+the zeros already in place.
+*/
+void disassemble_cut_off(struct text_writer *writer, const uint8_t *code,
+                         uint32_t address, struct cfg *cfg) {
+  struct instruction inst = {0};
+  decode_bytes(code, &inst);
+  disassemble_code(writer, code, inst.bsize, address, cfg);
+}
+
+/*
+Disassembles listing straight from file in large chunks, so its size is not
+limited by machine memory.
+*/
+void disassemble_file(FILE *f) {
+  struct text_writer *writer = malloc(sizeof(*writer));
+  uint8_t *chunk = malloc(DISASM_CHUNK_SIZE);
+  size_t filled = 0;
+  uint32_t address = 0;
+  size_t rb = 0;
+
+  writer_init(writer, stdout);
+
+  while ((rb = fread(chunk + filled, 1, DISASM_CHUNK_SIZE - filled, f)) != 0) {
+    filled += rb;
+
+    size_t used = disassemble_code(writer, chunk, filled, address, NULL);
+    memmove(chunk, chunk + used, filled - used);
+    filled -= used;
+    address += used;
+  }
+
+  if (filled != 0) {
+    memset(chunk + filled, 0, MAX_INSTRUCTION_SIZE);
+    disassemble_cut_off(writer, chunk, address, NULL);
+  }
+
+  writer_flush(writer);
+  free(chunk);
+  free(writer);
+}
+
+void disassemble(struct sim86 *sim, int16_t cnt, bool labels) {
+  struct text_writer *writer = malloc(sizeof(*writer));
+  struct cfg *cfg = labels ? cfg_build(sim, cnt) : NULL;
+
+  writer_init(writer, stdout);
+
+  /* memory past the program is zero */
+  size_t used = disassemble_code(writer, sim->memory, (uint16_t)cnt, 0, cfg);
+  if (used < (uint16_t)cnt) {
+    disassemble_cut_off(writer, sim->memory + used, used, cfg);
+  }
+
+  writer_flush(writer);
+
+  if (cfg != NULL) {
+    cfg_free(cfg);
+  }
+
+  free(writer);
+}
+
+/*
+Runs loaded program from current ip until it ends or watchdog stops it,
+returns executed instructions.
+*/
+uint64_t run_program(struct sim86 *sim, int16_t cnt, bool blocks, bool quiet,
+                     uint64_t dump_every) {
+  watchdog_start(sim);
+
+  if (callgraph_enabled) {
+    callgraph_start(sim);
+  }
+
+  if (blocks) {
+    uint64_t before = block_instructions(sim);
+
+    /* divide error was already reported by interpreter */
+    if (!block_run(sim, cnt) && !sim->divide_error) {
+      printf("unsupported instruction at 0x%x\n", sim->ip);
+    }
+
+    return block_instructions(sim) - before;
+  }
+
+  uint64_t instructions = 0;
+  while (sim->ip < cnt) {
+    struct instruction *instruction = icache_get(sim, sim->ip);
+    if (instruction == NULL) {
+      break;
+    }
+
+    if (!quiet) {
+      print_instruction(instruction);
+    }
+
+    struct execute_result exec_result = execute_instruction(sim, instruction);
+    if (exec_result.unimplemented) {
+      break;
+    }
+
+    instructions++;
+
+    if (dump_every != 0 && instructions % dump_every == 0) {
+      char path[64];
+      snprintf(path, sizeof(path), "sim86_mem_dump.%04llu.delta",
+               (unsigned long long)(instructions / dump_every));
+      write_delta_file(sim, path);
+    }
+
+    if (!quiet) {
+      printf("\n");
+    }
+
+    if (watchdog_active() && watchdog_expired(sim)) {
+      break;
+    }
+  }
+
+  return instructions;
+}
+
+/*
+Runs the loaded program once per line of runs_path (or repeat times with no
+inputs), restoring the initial machine state between runs.
+*/
+void run_variants(struct sim86 *sim, int16_t cnt, char *runs_path,
+                  uint64_t repeat, bool blocks) {
+  FILE *runs = NULL;
+  if (runs_path != NULL) {
+    runs = fopen(runs_path, "r");
+
+    if (runs == NULL) {
+      fprintf(stderr, "Cannot open file \"%s\", errno = %d\n", runs_path,
+              errno);
+      exit(1);
+    }
+  }
+
+  struct machine_snapshot snapshot = {0};
+  snapshot_take(sim, &snapshot);
+
+  char line[1024];
+  uint64_t run = 0;
+  uint64_t restored_pages = 0;
+
+  while (runs != NULL ? fgets(line, sizeof(line), runs) != NULL
+                      : run < repeat) {
+    if (runs == NULL) {
+      line[0] = '\0';
+    }
+
+    line[strcspn(line, "\r\n")] = '\0';
+    printf("run %llu: %s", (unsigned long long)++run, line);
+
+    for (char *token = strtok(line, " \t"); token != NULL;
+         token = strtok(NULL, " \t")) {
+      if (!sim86_apply_preset(sim, token)) {
+        printf(" (ignored \"%s\")", token);
+      }
+    }
+
+    uint64_t start = read_timer_ns();
+    uint64_t instructions = run_program(sim, cnt, blocks, true, 0);
+    uint64_t elapsed = read_timer_ns() - start;
+
+    printf(" -> clocks %llu, instructions %llu, ax 0x%x, %.3f ms",
+           (unsigned long long)(sim->total_clocks - snapshot.total_clocks),
+           (unsigned long long)instructions, sim->regs[0], elapsed / 1e6);
+
+    if (watchdog_stop_name(sim) != NULL) {
+      printf(", stopped: %s", watchdog_stop_name(sim));
+    }
+
+    printf("\n");
+
+    restored_pages += snapshot_restore(sim, &snapshot);
+  }
+
+  printf("\n%llu runs, %.1f pages restored per run\n", (unsigned long long)run,
+         run ? (double)restored_pages / run : 0.0);
+
+  if (runs != NULL) {
+    fclose(runs);
+  }
+
+  snapshot_free(&snapshot);
+}
+
+/*
+Runs every listing in paths on its own machine across threads, once per
+line of runs_path or repeat times.
+*/
+int run_batch(char **paths, int path_count, char *runs_path, uint64_t repeat,
+              int threads, bool blocks) {
+  char **variants = NULL;
+  int variant_count = 0;
+  int capacity = 0;
+
+  FILE *runs = NULL;
+  if (runs_path != NULL) {
+    runs = fopen(runs_path, "r");
+
+    if (runs == NULL) {
+      fprintf(stderr, "Cannot open file \"%s\", errno = %d\n", runs_path,
+              errno);
+      exit(1);
+    }
+  }
+
+  char line[1024];
+  while (runs != NULL ? fgets(line, sizeof(line), runs) != NULL
+                      : (uint64_t)variant_count < repeat) {
+    if (runs == NULL) {
+      line[0] = '\0';
+    }
+
+    line[strcspn(line, "\r\n")] = '\0';
+
+    if (variant_count == capacity) {
+      capacity = capacity ? capacity * 2 : 16;
+      variants = realloc(variants, capacity * sizeof(*variants));
+    }
+
+    variants[variant_count++] = strdup(line);
+  }
+
+  if (runs != NULL) {
+    fclose(runs);
+  }
+
+  int failed = batch_run(paths, path_count, variants, variant_count, threads,
+                         blocks);
+
+  for (int i = 0; i < variant_count; ++i) {
+    free(variants[i]);
+  }
+
+  free(variants);
+  return failed != 0;
+}
+
+/*
+Runs every listing in paths through the interpreter and through the block
+engine with every block compiled on its first run, then compares registers,
+flags, clocks and memory. Returns whether any listing differs.
+*/
+int verify_jit(char **paths, int path_count) {
+  int failed = 0;
+
+  print_execution = false;
+  mem_log_writes = false;
+  jit_enabled = true;
+  jit_threshold = 1;
+
+  for (int i = 0; i < path_count; ++i) {
+    struct sim86 *machines[2] = {sim86_create(), sim86_create()};
+    int16_t cnt = 0;
+
+    for (int m = 0; m < 2; ++m) {
+      FILE *fd = fopen(paths[i], "rb");
+      if (fd == NULL) {
+        fprintf(stderr, "Cannot open file \"%s\", errno = %d\n", paths[i],
+                errno);
+        exit(1);
+      }
+
+      cnt = mem_load_file(machines[m], 0, fd);
+      fclose(fd);
+    }
+
+    run_program(machines[0], cnt, false, true, 0);
+    run_program(machines[1], cnt, true, true, 0);
+
+    struct register_state expected, actual;
+    get_register_state(machines[0], &expected);
+    get_register_state(machines[1], &actual);
+
+    size_t differing_bytes = 0;
+    for (size_t addr = 0; addr < MEM_SIZE; ++addr) {
+      differing_bytes += machines[0]->memory[addr] != machines[1]->memory[addr];
+    }
+
+    bool same = memcmp(&expected, &actual, sizeof(expected)) == 0 &&
+                machines[0]->total_clocks == machines[1]->total_clocks &&
+                differing_bytes == 0;
+
+    /* no blocks exist when nothing ran */
+    struct block_cache *blocks = machines[1]->blocks;
+    printf("%s: %s, %llu clocks, %llu blocks compiled\n", paths[i],
+           same ? "ok" : "MISMATCH",
+           (unsigned long long)machines[0]->total_clocks,
+           (unsigned long long)(blocks ? blocks->stats.compiled : 0));
+
+    if (!same) {
+      failed++;
+
+      for (int r = 0; r < 8; ++r) {
+        if (expected.regs[r] != actual.regs[r]) {
+          printf("\t%s: 0x%x interpreted, 0x%x compiled\n",
+                 reg_names[r * 3 + 2], expected.regs[r], actual.regs[r]);
+        }
+      }
+
+      if (expected.ip != actual.ip) {
+        printf("\tip: 0x%x interpreted, 0x%x compiled\n", expected.ip,
+               actual.ip);
+      }
+
+      if (expected.flags != actual.flags) {
+        printf("\tflags: 0x%x interpreted, 0x%x compiled\n", expected.flags,
+               actual.flags);
+      }
+
+      if (machines[0]->total_clocks != machines[1]->total_clocks) {
+        printf("\tclocks: %llu interpreted, %llu compiled\n",
+               (unsigned long long)machines[0]->total_clocks,
+               (unsigned long long)machines[1]->total_clocks);
+      }
+
+      if (differing_bytes != 0) {
+        printf("\tmemory: %zu bytes differ\n", differing_bytes);
+      }
+    }
+
+    sim86_destroy(machines[0]);
+    sim86_destroy(machines[1]);
+  }
+
+  printf("\n%d of %d listings differ\n", failed, path_count);
+  return failed != 0;
+}
 
 int main(int argc, char **argv) {
   bool execute = false;
   bool dump = false;
+  bool stats = false;
+  bool blocks = false;
+  bool quiet = false;
+  bool bench = false;
+  bool labels = false;
+  bool estimate = false;
+  bool branch_report = false;
+  bool jit_verify = false;
+  bool biu = false;
+  bool sweep = false;
   char *fname = NULL;
+  char *trace_path = NULL;
+  char *dump_delta_path = NULL;
+  char *load_delta_path = NULL;
+  char *collapsed_path = NULL;
+  uint64_t dump_every = 0;
+  char *runs_path = NULL;
+  uint64_t repeat = 0;
+  int threads = 0;
+  int fname_index = 0;
 
   for (int arg_index = 1; arg_index < argc; ++arg_index) {
     char *arg = argv[arg_index];
@@ -26,8 +528,128 @@ int main(int argc, char **argv) {
       execute = true;
     } else if (strcmp(arg, "--dump") == 0) {
       dump = true;
+    } else if (strncmp(arg, "--dump-delta=", 13) == 0) {
+      dump_delta_path = arg + 13;
+    } else if (strncmp(arg, "--dump-every=", 13) == 0) {
+      dump_every = strtoull(arg + 13, NULL, 10);
+    } else if (strncmp(arg, "--load-delta=", 13) == 0) {
+      load_delta_path = arg + 13;
+    } else if (strcmp(arg, "--diff-dumps") == 0) {
+      if (arg_index + 2 >= argc) {
+        fprintf(stderr, "--diff-dumps needs two delta dump files.\n");
+        exit(1);
+      }
+
+      return diff_delta_files(argv[arg_index + 1], argv[arg_index + 2]);
+    } else if (strcmp(arg, "--blocks") == 0) {
+      execute = true;
+      quiet = true;
+      blocks = true;
+    } else if (strcmp(arg, "--jit") == 0) {
+      execute = true;
+      quiet = true;
+      blocks = true;
+      jit_enabled = true;
+    } else if (strncmp(arg, "--jit-threshold=", 16) == 0) {
+      jit_threshold = strtoul(arg + 16, NULL, 10);
+      if (jit_threshold == 0) {
+        fprintf(stderr, "--jit-threshold needs at least 1 run.\n");
+        exit(1);
+      }
+    } else if (strcmp(arg, "--jit-verify") == 0) {
+      jit_verify = true;
+    } else if (strcmp(arg, "--quiet") == 0) {
+      quiet = true;
+    } else if (strcmp(arg, "--bench") == 0) {
+      execute = true;
+      quiet = true;
+      bench = true;
+    } else if (strncmp(arg, "--trace=", 8) == 0) {
+      execute = true;
+      quiet = true;
+      trace_path = arg + 8;
+    } else if (strncmp(arg, "--runs=", 7) == 0) {
+      execute = true;
+      quiet = true;
+      runs_path = arg + 7;
+    } else if (strncmp(arg, "--repeat=", 9) == 0) {
+      execute = true;
+      quiet = true;
+      repeat = strtoull(arg + 9, NULL, 10);
+    } else if (strcmp(arg, "--no-specialize") == 0) {
+      use_specialized_handlers = false;
+    } else if (strncmp(arg, "--cpu=", 6) == 0) {
+      if (strcmp(arg + 6, "8086") == 0) {
+        bus_model.cpu = CPU_8086;
+      } else if (strcmp(arg + 6, "8088") == 0) {
+        bus_model.cpu = CPU_8088;
+      } else {
+        fprintf(stderr, "Unknown cpu \"%s\", expected 8086 or 8088.\n",
+                arg + 6);
+        exit(1);
+      }
+    } else if (strncmp(arg, "--wait-states=", 14) == 0) {
+      bus_model.wait_states = strtoul(arg + 14, NULL, 10);
+    } else if (strcmp(arg, "--profile") == 0) {
+      profile_enabled = true;
+    } else if (strcmp(arg, "--call-graph") == 0) {
+      callgraph_enabled = true;
+    } else if (strncmp(arg, "--collapsed-stacks=", 19) == 0) {
+      callgraph_enabled = true;
+      collapsed_path = arg + 19;
+    } else if (strcmp(arg, "--biu") == 0) {
+      biu = true;
+    } else if (strcmp(arg, "--sweep") == 0 ||
+               strncmp(arg, "--sweep=", 8) == 0) {
+      sweep = true;
+      char *spec = arg[7] == '=' ? arg + 8 : "";
+      if (!timing_sweep_configure(spec)) {
+        fprintf(stderr,
+                "Malformed sweep \"%s\", expected "
+                "CPU[:WAIT_STATES][:prefetch][,...] with up to %d models.\n",
+                spec, TIMING_MAX_MODELS);
+        exit(1);
+      }
+    } else if (strncmp(arg, "--cache=", 8) == 0) {
+      if (!cache_configure(arg + 8)) {
+        fprintf(stderr,
+                "Malformed cache \"%s\", expected "
+                "SIZE:LINE:WAYS[:lru|fifo|random][,...] for up to %d levels "
+                "with power of two lines and sets.\n",
+                arg + 8, CACHE_MAX_LEVELS);
+        exit(1);
+      }
+    } else if (strcmp(arg, "--branch-stats") == 0) {
+      branch_stats_enabled = true;
+      branch_report = true;
+    } else if (strcmp(arg, "--stats") == 0) {
+      stats = true;
+    } else if (strcmp(arg, "--labels") == 0) {
+      labels = true;
+    } else if (strcmp(arg, "--estimate") == 0) {
+      estimate = true;
+    } else if (strncmp(arg, "--trips=", 8) == 0) {
+      estimate = true;
+      if (!cfg_parse_trip_counts(arg + 8)) {
+        fprintf(stderr, "Malformed trip counts \"%s\", expected IP:N,...\n",
+                arg + 8);
+        exit(1);
+      }
+    } else if (strcmp(arg, "--addr") == 0) {
+      show_address = true;
+    } else if (strcmp(arg, "--bytes") == 0) {
+      show_bytes = true;
+    } else if (strncmp(arg, "--max-instructions=", 19) == 0) {
+      watchdog.max_instructions = strtoull(arg + 19, NULL, 10);
+    } else if (strncmp(arg, "--max-clocks=", 13) == 0) {
+      watchdog.max_clocks = strtoull(arg + 13, NULL, 10);
+    } else if (strcmp(arg, "--detect-hangs") == 0) {
+      watchdog.detect_hangs = true;
+    } else if (strncmp(arg, "--threads=", 10) == 0) {
+      threads = strtol(arg + 10, NULL, 10);
     } else {
       fname = arg;
+      fname_index = arg_index;
       break;
     }
   }
@@ -37,8 +659,57 @@ int main(int argc, char **argv) {
     exit(1);
   }
 
+  /* queue model runs on bus chosen by --cpu and --wait-states */
+  struct timing_model *biu_model = NULL;
+  if (biu) {
+    biu_model = timing_model_add(bus_model, true);
+  }
+
+  if (jit_verify) {
+    /* every remaining argument is a listing */
+    return verify_jit(&argv[fname_index], argc - fname_index);
+  }
+
+  if (threads > 0) {
+    if (trace_path != NULL || profile_enabled || timing_models_enabled ||
+        branch_stats_enabled || callgraph_enabled) {
+      fprintf(stderr, "--threads cannot be used with --trace, --profile, "
+                      "--biu, --sweep, --call-graph, --collapsed-stacks or "
+                      "--branch-stats.\n");
+      exit(1);
+    }
+
+    /* every remaining argument is a listing */
+    print_execution = false;
+    mem_log_writes = false;
+
+    /* one runaway listing must not hold up the whole batch */
+    watchdog.detect_hangs = true;
+    if (watchdog.max_instructions == 0 && watchdog.max_clocks == 0) {
+      watchdog.max_instructions = WATCHDOG_BATCH_INSTRUCTIONS;
+    }
+
+    return run_batch(&argv[fname_index], argc - fname_index, runs_path, repeat,
+                     threads, blocks);
+  }
+
+  struct sim86 *sim = sim86_create();
+
+  if (trace_path != NULL && blocks) {
+    fprintf(stderr, "--trace cannot be used with --blocks.\n");
+    exit(1);
+  }
+
+  /* blocks run many instructions at once, so counts would be missed */
+  if (dump_every != 0 && blocks) {
+    fprintf(stderr, "--dump-every cannot be used with --blocks.\n");
+    exit(1);
+  }
+
   if (execute) {
     printf("--- execute: %s ---\n", fname);
+  } else if (estimate) {
+    printf("--- estimate: %s ---\n", fname);
   } else {
     printf("; %s disassembly:\n", fname);
     printf("bits 16\n");
@@ -51,7 +722,7 @@ int main(int argc, char **argv) {
     exit(1);
   }
 
-  int16_t cnt = mem_load_file(0, fd);
+  int16_t cnt = mem_load_file(sim, 0, fd);
   if (cnt < 0) {
     printf("error while loading file\n");
   }
@@ -61,34 +732,132 @@ int main(int argc, char **argv) {
     exit(1);
   }
 
-  size_t ip = 0;
-  while (ip < cnt) {
-    struct instruction instruction = {0};
-    if (!decode_instruction(ip, &instruction)) {
-      break;
+  if (load_delta_path != NULL) {
+    struct mem_delta delta;
+    if (!read_delta_file(load_delta_path, &delta)) {
+      exit(1);
     }
 
-    print_instruction(&instruction);
+    mem_delta_apply(sim, &delta);
+    mem_delta_free(&delta);
+  }
 
-    if (execute) {
-      struct execute_result exec_result = execute_instruction(&instruction);
-      ip = exec_result.next_ip;
-    } else {
-      ip += instruction.bsize;
+  if (trace_path != NULL && !trace_open(sim, trace_path, fname, cnt)) {
+    fprintf(stderr, "Cannot open trace file \"%s\", errno = %d\n", trace_path,
+            errno);
+    exit(1);
+  }
+
+  if (quiet) {
+    print_execution = false;
+    mem_log_writes = false;
+  }
+
+  /* graph of code as loaded, before it can modify itself */
+  struct cfg *cfg = NULL;
+  if (estimate) {
+    cfg = cfg_build(sim, cnt);
+    branch_stats_enabled = true;
+  }
+
+  uint64_t instructions = 0;
+  uint64_t start = read_timer_ns();
+
+  bool variants = runs_path != NULL || repeat != 0;
+
+  if (variants) {
+    run_variants(sim, cnt, runs_path, repeat, blocks);
+  } else if (execute) {
+    instructions = run_program(sim, cnt, blocks, quiet, dump_every);
+  } else if (estimate) {
+    cfg_print_report(cfg, cfg_estimate(cfg, false), 0);
+  } else if (load_delta_path != NULL || labels) {
+    /* labels need whole program, delta patches memory */
+    disassemble(sim, cnt, labels);
+  } else {
+    fd = fopen(fname, "rb");
+    if (fd == NULL) {
+      fprintf(stderr, "Cannot open file \"%s\", errno = %d\n.", fname, errno);
+      exit(1);
     }
 
-    printf("\n");
+    disassemble_file(fd);
+    fclose(fd);
   }
 
-  if (execute) {
-    print_registers_state();
+  uint64_t elapsed = read_timer_ns() - start;
+
+  if (execute && !variants) {
+    print_registers_state(sim);
+    watchdog_print_report(sim);
+
+    if (blocks) {
+      block_print_stats(sim, elapsed);
+    }
+
+    if (bench) {
+      print_bench_report(sim, instructions, elapsed);
+    }
+
+    if (stats) {
+      icache_print_stats(sim);
+    }
+
+    if (branch_report) {
+      branch_print_report(sim);
+    }
+
+    if (biu_model != NULL) {
+      biu_print_stats(&biu_model->biu, sim->total_clocks);
+    }
+
+    if (sweep) {
+      timing_sweep_print_report(sim);
+    }
+
+    if (cache_enabled) {
+      cache_print_report(sim);
+    }
+
+    if (profile_enabled) {
+      profile_print_report(sim);
+    }
+
+    if (callgraph_enabled) {
+      callgraph_print_report(sim);
+    }
+
+    if (collapsed_path != NULL &&
+        !callgraph_write_collapsed(sim, collapsed_path)) {
+      fprintf(stderr, "Cannot write collapsed stacks \"%s\", errno = %d\n",
+              collapsed_path, errno);
+    }
+
+    if (estimate) {
+      cfg_print_report(cfg, cfg_estimate(cfg, true), sim->total_clocks);
+    }
+  }
+
+  if (cfg != NULL) {
+    cfg_free(cfg);
+  }
+
+  if (trace_enabled) {
+    struct register_state state;
+    get_register_state(sim, &state);
+    trace_close(&state, sim->total_clocks);
   }
 
   if (dump) {
     FILE *fd = fopen("sim86_mem_dump.data", "wb");
-    mem_dump(fd);
+    mem_dump(sim, fd);
     fclose(fd);
   }
 
+  if (dump_delta_path != NULL) {
+    write_delta_file(sim, dump_delta_path);
+  }
+
+  sim86_destroy(sim);
   return 0;
 }
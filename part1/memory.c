@@ -1,52 +1,342 @@
 #include "memory.h"
+#include "cache.h"
+#include "icache.h"
+#include "sim86.h"
+#include "trace.h"
+#include "watchdog.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#define MEM_SIZE 65536
 #define BUF_SIZE 1024
 
-uint8_t memory[MEM_SIZE] = {0};
+bool mem_log_writes = true;
 
-int16_t mem_load_file(uint16_t offset, FILE *f) {
+void mem_mark_dirty(struct sim86 *sim, uint16_t addr) {
+  uint16_t page = addr / MEM_PAGE_SIZE;
+  sim->mem_dirty[page / 64] |= 1ull << (page % 64);
+  sim->mem_touched[page / 64] |= 1ull << (page % 64);
+}
+
+bool page_is_set(const uint64_t *pages, uint16_t page) {
+  return (pages[page / 64] >> (page % 64)) & 1;
+}
+
+int16_t mem_load_file(struct sim86 *sim, uint16_t offset, FILE *f) {
   uint8_t buf[BUF_SIZE];
   size_t rb = 0;
-  while ((rb = fread(buf, 1, BUF_SIZE, f)) != 0) {
-    if (rb < 0) {
-      return -1;
+  size_t end = offset;
+
+  /* anything past end of memory is not loaded */
+  while (end < MEM_SIZE) {
+    size_t room = MEM_SIZE - end;
+    rb = fread(buf, 1, room < BUF_SIZE ? room : BUF_SIZE, f);
+    if (rb == 0) {
+      break;
     }
 
     for (size_t i = 0; i < rb; ++i) {
-      memory[offset + i] = buf[i];
+      sim->memory[end + i] = buf[i];
+      mem_mark_dirty(sim, end + i);
     }
 
-    offset = rb;
+    end += rb;
+  }
+
+  return end;
+}
+
+uint8_t mem_read_byte(struct sim86 *sim, uint16_t addr) {
+  if (cache_enabled) {
+    cache_access(sim, addr, 1, CACHE_READ);
+  }
+
+  return sim->memory[addr];
+}
+
+uint16_t mem_read_word(struct sim86 *sim, uint16_t addr) {
+  if (cache_enabled) {
+    cache_access(sim, addr, 2, CACHE_READ);
+  }
+
+  return sim->memory[addr] | (sim->memory[(uint16_t)(addr + 1)] << 8);
+}
+
+void mem_save_byte(struct sim86 *sim, uint16_t addr, uint8_t value) {
+  if (mem_log_writes) {
+    printf("[0x%X] save: %d\n", addr, value);
+  }
+
+  if (trace_enabled) {
+    trace_write(addr, value, 1);
+  }
+
+  if (cache_enabled) {
+    cache_access(sim, addr, 1, CACHE_WRITE);
+  }
+
+  if (watchdog.detect_hangs) {
+    watchdog_hash_range(sim, addr, 1);
+  }
+
+  sim->memory[addr] = value;
+
+  if (watchdog.detect_hangs) {
+    watchdog_hash_range(sim, addr, 1);
+  }
+
+  mem_mark_dirty(sim, addr);
+  icache_invalidate(sim, addr, 1);
+}
+
+void mem_save_word(struct sim86 *sim, uint16_t addr, uint16_t value) {
+  if (mem_log_writes) {
+    printf("[0x%X] save: %d\n", addr, value);
+  }
+
+  if (trace_enabled) {
+    trace_write(addr, value, 2);
+  }
+
+  if (cache_enabled) {
+    cache_access(sim, addr, 2, CACHE_WRITE);
+  }
+
+  if (watchdog.detect_hangs) {
+    watchdog_hash_range(sim, addr, 2);
+  }
+
+  sim->memory[addr] = value;
+  sim->memory[(uint16_t)(addr + 1)] = value >> 8;
+
+  if (watchdog.detect_hangs) {
+    watchdog_hash_range(sim, addr, 2);
   }
 
-  return offset;
+  mem_mark_dirty(sim, addr);
+  mem_mark_dirty(sim, addr + 1);
+  icache_invalidate(sim, addr, 2);
+}
+
+void mem_mark_range(struct sim86 *sim, uint16_t addr, uint32_t n) {
+  uint32_t last = (addr + n - 1) / MEM_PAGE_SIZE;
+
+  for (uint32_t page = addr / MEM_PAGE_SIZE; page <= last; ++page) {
+    mem_mark_dirty(sim, page * MEM_PAGE_SIZE);
+  }
 }
 
-uint16_t mem_read_word(uint16_t addr) {
-  return memory[addr] | (memory[addr + 1] << 8);
+void mem_move(struct sim86 *sim, uint16_t dst, uint16_t src, uint32_t n) {
+  if (watchdog.detect_hangs) {
+    watchdog_hash_range(sim, dst, n);
+  }
+
+  memmove(sim->memory + dst, sim->memory + src, n);
+
+  if (watchdog.detect_hangs) {
+    watchdog_hash_range(sim, dst, n);
+  }
+
+  mem_mark_range(sim, dst, n);
+  icache_invalidate(sim, dst, n);
 }
 
-void mem_save_word(uint16_t addr, uint16_t value) {
-  printf("[0x%X] save: %d\n", addr, value);
-  memory[addr] = value;
-  memory[addr + 1] = value >> 8;
+void mem_fill(struct sim86 *sim, uint16_t addr, uint32_t count,
+              uint16_t value, uint16_t width) {
+  uint32_t n = count * width;
+
+  if (watchdog.detect_hangs) {
+    watchdog_hash_range(sim, addr, n);
+  }
+
+  if (width == 1 || (value & 0xff) == value >> 8) {
+    memset(sim->memory + addr, value & 0xff, n);
+  } else {
+    for (uint32_t i = 0; i < n; i += 2) {
+      sim->memory[addr + i] = value;
+      sim->memory[addr + i + 1] = value >> 8;
+    }
+  }
+
+  if (watchdog.detect_hangs) {
+    watchdog_hash_range(sim, addr, n);
+  }
+
+  mem_mark_range(sim, addr, n);
+  icache_invalidate(sim, addr, n);
 }
 
-int16_t mem_readn(uint16_t offset, uint8_t *buf, size_t n) {
+int16_t mem_readn(struct sim86 *sim, uint16_t offset, uint8_t *buf, size_t n) {
   if (offset + n > MEM_SIZE) {
     n = MEM_SIZE - offset;
   }
 
   int i = 0;
   for (; i < n; ++i) {
-    buf[i] = memory[offset + i];
+    buf[i] = sim->memory[offset + i];
   }
 
   return i;
 }
 
-void mem_dump(FILE *f) { fwrite(memory, MEM_SIZE, 1, f); }
+void mem_dump(struct sim86 *sim, FILE *f) {
+  fwrite(sim->memory, MEM_SIZE, 1, f);
+}
+
+void mem_snapshot(struct sim86 *sim, uint8_t *copy) {
+  memcpy(copy, sim->memory, MEM_SIZE);
+
+  for (uint16_t word = 0; word < MEM_DIRTY_WORDS; ++word) {
+    sim->mem_touched[word] = 0;
+  }
+}
+
+uint16_t mem_rollback(struct sim86 *sim, const uint8_t *copy) {
+  uint16_t restored = 0;
+
+  for (uint16_t word = 0; word < MEM_DIRTY_WORDS; ++word) {
+    uint64_t bits = sim->mem_touched[word];
+    sim->mem_touched[word] = 0;
+
+    while (bits) {
+      uint16_t page = word * 64 + __builtin_ctzll(bits);
+      uint16_t addr = page * MEM_PAGE_SIZE;
+      bits &= bits - 1;
+
+      memcpy(&sim->memory[addr], &copy[addr], MEM_PAGE_SIZE);
+      sim->mem_dirty[word] |= 1ull << (page % 64);
+      icache_invalidate(sim, addr, MEM_PAGE_SIZE);
+      restored++;
+    }
+  }
+
+  return restored;
+}
+
+void mem_delta_capture(struct sim86 *sim, struct mem_delta *delta) {
+  *delta = (struct mem_delta){0};
+
+  for (uint16_t word = 0; word < MEM_DIRTY_WORDS; ++word) {
+    uint64_t bits = sim->mem_dirty[word];
+    sim->mem_dirty[word] = 0;
+
+    while (bits) {
+      uint16_t page = word * 64 + __builtin_ctzll(bits);
+      bits &= bits - 1;
+
+      delta->pages[page / 64] |= 1ull << (page % 64);
+      delta->data[page] = malloc(MEM_PAGE_SIZE);
+      memcpy(delta->data[page], &sim->memory[page * MEM_PAGE_SIZE],
+             MEM_PAGE_SIZE);
+      delta->count++;
+    }
+  }
+}
+
+void mem_delta_apply(struct sim86 *sim, struct mem_delta *delta) {
+  for (uint16_t page = 0; page < MEM_PAGE_COUNT; ++page) {
+    if (!page_is_set(delta->pages, page)) {
+      continue;
+    }
+
+    uint16_t addr = page * MEM_PAGE_SIZE;
+    memcpy(&sim->memory[addr], delta->data[page], MEM_PAGE_SIZE);
+    mem_mark_dirty(sim, addr);
+    icache_invalidate(sim, addr, MEM_PAGE_SIZE);
+  }
+}
+
+void mem_delta_free(struct mem_delta *delta) {
+  for (uint16_t page = 0; page < MEM_PAGE_COUNT; ++page) {
+    free(delta->data[page]);
+  }
+
+  *delta = (struct mem_delta){0};
+}
+
+void mem_delta_write(FILE *f, struct mem_delta *delta) {
+  uint8_t header[8] = {MEM_DELTA_MAGIC[0], MEM_DELTA_MAGIC[1],
+                       MEM_DELTA_MAGIC[2], MEM_DELTA_MAGIC[3],
+                       MEM_PAGE_SIZE & 0xff, MEM_PAGE_SIZE >> 8,
+                       delta->count & 0xff, delta->count >> 8};
+  fwrite(header, sizeof(header), 1, f);
+
+  for (uint16_t page = 0; page < MEM_PAGE_COUNT; ++page) {
+    if (!page_is_set(delta->pages, page)) {
+      continue;
+    }
+
+    uint16_t addr = page * MEM_PAGE_SIZE;
+    uint8_t offset[2] = {addr & 0xff, addr >> 8};
+    fwrite(offset, sizeof(offset), 1, f);
+    fwrite(delta->data[page], MEM_PAGE_SIZE, 1, f);
+  }
+}
+
+bool mem_delta_read(FILE *f, struct mem_delta *delta) {
+  *delta = (struct mem_delta){0};
+
+  uint8_t header[8];
+  if (fread(header, sizeof(header), 1, f) != 1 ||
+      memcmp(header, MEM_DELTA_MAGIC, 4) != 0 ||
+      (header[4] | (header[5] << 8)) != MEM_PAGE_SIZE) {
+    return false;
+  }
+
+  uint16_t count = header[6] | (header[7] << 8);
+  for (uint16_t i = 0; i < count; ++i) {
+    uint8_t offset[2];
+    uint8_t *data = malloc(MEM_PAGE_SIZE);
+
+    if (fread(offset, sizeof(offset), 1, f) != 1 ||
+        fread(data, MEM_PAGE_SIZE, 1, f) != 1) {
+      free(data);
+      mem_delta_free(delta);
+      return false;
+    }
+
+    uint16_t page = (offset[0] | (offset[1] << 8)) / MEM_PAGE_SIZE;
+    if (delta->data[page] == NULL) {
+      delta->count++;
+    }
+
+    free(delta->data[page]);
+    delta->data[page] = data;
+    delta->pages[page / 64] |= 1ull << (page % 64);
+  }
+
+  return true;
+}
+
+size_t mem_delta_diff(struct mem_delta *a, struct mem_delta *b, FILE *out) {
+  size_t differences = 0;
+
+  for (uint16_t word = 0; word < MEM_DIRTY_WORDS; ++word) {
+    uint64_t bits = a->pages[word] | b->pages[word];
+
+    while (bits) {
+      uint16_t page = word * 64 + __builtin_ctzll(bits);
+      uint16_t base = page * MEM_PAGE_SIZE;
+      bits &= bits - 1;
+
+      if (a->data[page] == NULL || b->data[page] == NULL) {
+        fprintf(out, "[0x%04x] page only in %s\n", base,
+                a->data[page] ? "first" : "second");
+        differences += MEM_PAGE_SIZE;
+        continue;
+      }
+
+      for (uint16_t i = 0; i < MEM_PAGE_SIZE; ++i) {
+        if (a->data[page][i] != b->data[page][i]) {
+          fprintf(out, "[0x%04x] 0x%02x -> 0x%02x\n", base + i,
+                  a->data[page][i], b->data[page][i]);
+          differences++;
+        }
+      }
+    }
+  }
+
+  return differences;
+}
@@ -1,14 +1,76 @@
 #ifndef MEMORY_H
 #define MEMORY_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-int16_t mem_load_file(uint16_t offset, FILE *f);
-uint16_t mem_read_word(uint16_t addr);
-void mem_save_word(uint16_t addr, uint16_t value);
-int16_t mem_readn(uint16_t offset, uint8_t *buf, size_t n);
-void mem_dump(FILE *f);
+#define MEM_SIZE 65536
+#define MEM_PAGE_SIZE 256
+#define MEM_PAGE_COUNT (MEM_SIZE / MEM_PAGE_SIZE)
+#define MEM_DIRTY_WORDS (MEM_PAGE_COUNT / 64)
+
+#define MEM_DELTA_MAGIC "S86D"
+
+struct sim86;
+
+/* print every word stored by mem_save_word() */
+extern bool mem_log_writes;
+
+/*
+Copies of pages written between two captures.
+
+File format, little endian: "S86D", u16 page size, u16 page count, then for
+every page u16 address of its first byte followed by the page bytes.
+*/
+struct mem_delta {
+  uint64_t pages[MEM_DIRTY_WORDS];
+  uint8_t *data[MEM_PAGE_COUNT];
+  uint16_t count;
+};
+
+int16_t mem_load_file(struct sim86 *sim, uint16_t offset, FILE *f);
+uint8_t mem_read_byte(struct sim86 *sim, uint16_t addr);
+uint16_t mem_read_word(struct sim86 *sim, uint16_t addr);
+void mem_save_byte(struct sim86 *sim, uint16_t addr, uint8_t value);
+void mem_save_word(struct sim86 *sim, uint16_t addr, uint16_t value);
+/*
+Bulk stores for repeated string instructions. They neither log, trace nor
+feed cache model, so they are used only when none of those is enabled. Ranges must not wrap around
+end of memory, mem_move() handles overlapping ones.
+*/
+void mem_move(struct sim86 *sim, uint16_t dst, uint16_t src, uint32_t n);
+/* Stores count elements of width bytes, all equal to value, from addr up. */
+void mem_fill(struct sim86 *sim, uint16_t addr, uint32_t count,
+              uint16_t value, uint16_t width);
+
+int16_t mem_readn(struct sim86 *sim, uint16_t offset, uint8_t *buf, size_t n);
+void mem_dump(struct sim86 *sim, FILE *f);
+
+/* Copies whole memory into copy and starts tracking written pages. */
+void mem_snapshot(struct sim86 *sim, uint8_t *copy);
+
+/*
+Copies back only pages written since mem_snapshot(). Returns number of
+restored pages.
+*/
+uint16_t mem_rollback(struct sim86 *sim, const uint8_t *copy);
+
+/*
+Copies pages written since the previous capture (or since start, loaded
+program included) and starts tracking from scratch.
+*/
+void mem_delta_capture(struct sim86 *sim, struct mem_delta *delta);
+void mem_delta_apply(struct sim86 *sim, struct mem_delta *delta);
+void mem_delta_free(struct mem_delta *delta);
+void mem_delta_write(FILE *f, struct mem_delta *delta);
+bool mem_delta_read(FILE *f, struct mem_delta *delta);
+
+/*
+Prints bytes that differ between two deltas, visiting only pages present in
+either of them. Returns number of differing bytes.
+*/
+size_t mem_delta_diff(struct mem_delta *a, struct mem_delta *b, FILE *out);
 
 #endif // MEMORY_H
@@ -0,0 +1,79 @@
+#include "profile.h"
+#include "decode.h"
+#include "display.h"
+#include "instruction.h"
+#include "sim86.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define PROFILE_SITES 65536
+#define PROFILE_BAR_WIDTH 40
+
+bool profile_enabled = false;
+
+struct profile_site profile_sites[PROFILE_SITES] = {0};
+struct profile_site profile_mix[INST_COUNT] = {0};
+
+void profile_record(uint16_t ip, enum instruction_type type, uint32_t clocks) {
+  profile_sites[ip].hits++;
+  profile_sites[ip].clocks += clocks;
+  profile_mix[type].hits++;
+  profile_mix[type].clocks += clocks;
+}
+
+void print_share_bar(double share) {
+  int width = (int)(share * PROFILE_BAR_WIDTH + 0.5);
+
+  for (int i = 0; i < PROFILE_BAR_WIDTH; ++i) {
+    putchar(i < width ? '#' : ' ');
+  }
+}
+
+void profile_print_report(struct sim86 *sim) {
+  uint64_t hits = 0;
+  uint64_t clocks = 0;
+
+  for (size_t i = 0; i < INST_COUNT; ++i) {
+    hits += profile_mix[i].hits;
+    clocks += profile_mix[i].clocks;
+  }
+
+  printf("\nProfile:\n");
+  printf("\t    ip        hits       clocks   share\n");
+
+  for (size_t i = 0; i < PROFILE_SITES; ++i) {
+    struct profile_site *site = &profile_sites[i];
+    if (site->hits == 0) {
+      continue;
+    }
+
+    double share = clocks ? (double)site->clocks / clocks : 0.0;
+    struct instruction instruction = {0};
+    decode_instruction(sim, i, &instruction);
+
+    printf("\t0x%04zx %11llu %12llu  %5.1f%% |", i,
+           (unsigned long long)site->hits, (unsigned long long)site->clocks,
+           100.0 * share);
+    print_share_bar(share);
+    printf("| ");
+    print_instruction(&instruction);
+    printf("\n");
+  }
+
+  printf("\nInstruction mix:\n");
+  printf("\t  name        count    count%%       clocks  clocks%%\n");
+
+  for (size_t i = 0; i < INST_COUNT; ++i) {
+    struct profile_site *mix = &profile_mix[i];
+    if (mix->hits == 0) {
+      continue;
+    }
+
+    struct instruction instruction = {.type = i};
+    printf("\t%6s %12llu  %6.1f%% %12llu  %6.1f%%\n",
+           inst_get_name(&instruction), (unsigned long long)mix->hits,
+           100.0 * mix->hits / hits, (unsigned long long)mix->clocks,
+           clocks ? 100.0 * mix->clocks / clocks : 0.0);
+  }
+}
@@ -0,0 +1,22 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "instruction.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+struct sim86;
+
+struct profile_site {
+  uint64_t hits;
+  uint64_t clocks; /* clocks from get_timing() of every execution */
+};
+
+extern bool profile_enabled;
+
+void profile_record(uint16_t ip, enum instruction_type type, uint32_t clocks);
+
+/* Prints annotated listing of executed addresses and instruction mix. */
+void profile_print_report(struct sim86 *sim);
+
+#endif // PROFILE_H
@@ -0,0 +1,170 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decode.h"
+#include "display.h"
+#include "encode.h"
+#include "generate.h"
+#include "memory.h"
+#include "sim86.h"
+#include "timer.h"
+
+/*
+Checks that decoding and encoding are inverse of each other without nasm:
+every instruction is decoded, encoded back and compared with original bytes.
+Inputs are either assembled listings or random streams of valid instructions.
+*/
+
+struct roundtrip_stats {
+  uint64_t instructions;
+  uint64_t bytes;
+  uint64_t mismatches;
+  uint64_t opcode_hits[256];
+};
+
+#define MAX_REPORTED_MISMATCHES 16
+
+void print_bytes(uint8_t *bytes, uint8_t n) {
+  for (uint8_t i = 0; i < n; ++i) {
+    printf(" %02x", bytes[i]);
+  }
+}
+
+/* Round-trips instructions in sim memory from 0 up to end. */
+void roundtrip_memory(struct sim86 *sim, uint32_t end,
+                      struct roundtrip_stats *stats) {
+  uint32_t ip = 0;
+
+  while (ip < end) {
+    struct instruction inst = {0};
+    if (!decode_instruction(sim, ip, &inst)) {
+      break;
+    }
+
+    uint8_t original[MAX_INSTRUCTION_SIZE];
+    uint8_t encoded[MAX_INSTRUCTION_SIZE];
+    uint8_t size = encode_instruction(&inst, encoded);
+
+    mem_readn(sim, ip, original, inst.bsize);
+    stats->opcode_hits[inst.opcode]++;
+    stats->instructions++;
+    stats->bytes += inst.bsize;
+
+    if (size != inst.bsize || memcmp(original, encoded, size) != 0) {
+      if (stats->mismatches < MAX_REPORTED_MISMATCHES) {
+        printf("mismatch at 0x%x: ", ip);
+        print_instruction(&inst);
+        printf("\n\tdecoded:");
+        print_bytes(original, inst.bsize);
+        printf("\n\tencoded:");
+        print_bytes(encoded, size);
+        printf("\n");
+      }
+
+      stats->mismatches++;
+    }
+
+    ip += inst.bsize;
+  }
+}
+
+void roundtrip_random(struct sim86 *sim, uint64_t count,
+                      struct roundtrip_stats *stats) {
+  uint8_t *stream = malloc(MEM_SIZE);
+
+  while (count > 0) {
+    uint64_t generated = 0;
+    size_t end = generate_instructions(stream, MEM_SIZE, count, &generated);
+
+    memcpy(sim->memory, stream, end);
+    roundtrip_memory(sim, end, stats);
+    count -= generated;
+  }
+
+  free(stream);
+}
+
+void print_roundtrip_report(struct roundtrip_stats *stats, uint64_t elapsed) {
+  uint16_t opcode_count = 0;
+  uint16_t opcodes_hit = 0;
+
+  for (uint16_t opcode = 0; opcode < 256; ++opcode) {
+    if (instructions[opcode].size != 0) {
+      opcode_count++;
+      opcodes_hit += stats->opcode_hits[opcode] != 0;
+    }
+  }
+
+  double seconds = elapsed / 1e9;
+
+  printf("\nRound trip:\n");
+  printf("\tinstructions: %lu\n", stats->instructions);
+  printf("\tbytes: %lu\n", stats->bytes);
+  printf("\topcodes covered: %u/%u\n", opcodes_hit, opcode_count);
+  printf("\tmismatches: %lu\n", stats->mismatches);
+  printf("\ttime: %.3f ms\n", elapsed / 1e6);
+
+  if (seconds > 0) {
+    printf("\tspeed: %.2f M instructions/s\n",
+           stats->instructions / seconds / 1e6);
+  }
+}
+
+int main(int argc, char **argv) {
+  uint64_t random_count = 0;
+  int first_path = argc;
+
+  for (int arg_index = 1; arg_index < argc; ++arg_index) {
+    char *arg = argv[arg_index];
+
+    if (strncmp(arg, "--random=", 9) == 0) {
+      random_count = strtoull(arg + 9, NULL, 0);
+    } else if (strncmp(arg, "--seed=", 7) == 0) {
+      generate_seed(strtoull(arg + 7, NULL, 0));
+    } else {
+      first_path = arg_index;
+      break;
+    }
+  }
+
+  if (random_count == 0 && first_path == argc) {
+    fprintf(stderr, "usage: sim86_roundtrip [--random=N] [--seed=S] "
+                    "[input_file ...]\n");
+    exit(1);
+  }
+
+  struct roundtrip_stats *stats = calloc(1, sizeof(*stats));
+  struct sim86 *sim = sim86_create();
+  uint64_t start = read_timer_ns();
+
+  for (int arg_index = first_path; arg_index < argc; ++arg_index) {
+    char *path = argv[arg_index];
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+      fprintf(stderr, "Cannot open file \"%s\", errno = %d\n.", path, errno);
+      exit(1);
+    }
+
+    memset(sim->memory, 0, MEM_SIZE);
+    int16_t cnt = mem_load_file(sim, 0, f);
+    fclose(f);
+
+    roundtrip_memory(sim, (uint16_t)cnt, stats);
+  }
+
+  if (random_count > 0) {
+    roundtrip_random(sim, random_count, stats);
+  }
+
+  print_roundtrip_report(stats, read_timer_ns() - start);
+
+  bool failed = stats->mismatches != 0;
+  sim86_destroy(sim);
+  free(stats);
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,15 @@
+bits 16
+
+; largest quotient that fits, then one that does not
+mov bx, 1
+mov dx, 0
+mov ax, 0xffff
+div bx
+mov bx, 0xffff
+mov dx, 0xfffe
+mov ax, 0xffff
+div bx
+mov bx, 1
+mov dx, 1
+mov ax, 0
+div bx
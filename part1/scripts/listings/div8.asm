@@ -0,0 +1,12 @@
+bits 16
+
+; largest quotients that fit, then one that does not
+mov bl, 1
+mov ax, 0x00ff
+div bl
+mov bl, 0xff
+mov ax, 0xfeff
+div bl
+mov bl, 1
+mov ax, 0x0100
+div bl
@@ -0,0 +1,16 @@
+; Hangs in the two instructions at 0x2-0x6 after a loop at 0xa that ran to
+; its end. The reported loop must not reach into the finished one.
+
+bits 16
+
+  jmp start
+
+hang:
+  add ax, 0
+  jmp hang
+
+start:
+  mov cx, 5
+spin:
+  loop spin
+  jmp hang
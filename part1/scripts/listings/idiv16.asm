@@ -0,0 +1,13 @@
+bits 16
+
+; 8086 takes quotients -32767..32767, -32768 raises divide error
+mov bx, 1
+mov dx, 0
+mov ax, 32767
+idiv bx
+mov dx, 0xffff
+mov ax, -32767
+idiv bx
+mov dx, 0xffff
+mov ax, -32768
+idiv bx
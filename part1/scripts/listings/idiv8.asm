@@ -0,0 +1,14 @@
+bits 16
+
+; 8086 takes quotients -127..127, -128 raises divide error
+mov bl, 1
+mov ax, 127
+idiv bl
+mov ax, -127
+idiv bl
+mov bl, 0xff
+mov ax, 127
+idiv bl
+mov bl, 1
+mov ax, -128
+idiv bl
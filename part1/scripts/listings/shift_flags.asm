@@ -0,0 +1,35 @@
+bits 16
+
+; single bit shifts: OF is MSB of result xor CF for left shifts
+mov al, 0x40
+shl al, 1
+mov al, 0x81
+shl al, 1
+; SHR sets OF to MSB of operand, SAR clears it
+mov al, 0x81
+shr al, 1
+mov al, 0x81
+sar al, 1
+; rotates: OF from CF for left, from two top bits of result for right
+mov al, 0x80
+rol al, 1
+mov al, 0x01
+ror al, 1
+mov al, 0x40
+rcl al, 1
+mov al, 0x81
+rcr al, 1
+; word operand
+mov ax, 0x8000
+shr ax, 1
+; by CL: CF is last bit shifted out, OF follows rule of last step
+mov cl, 4
+mov al, 0x0f
+shl al, cl
+mov al, 0x18
+shr al, cl
+mov al, 0x12
+rol al, cl
+; count 0 leaves value and flags alone
+mov cl, 0
+shl al, cl
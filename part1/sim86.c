@@ -0,0 +1,62 @@
+#include "sim86.h"
+#include "block.h"
+#include "cache.h"
+#include "display.h"
+#include "execute.h"
+#include "jit.h"
+#include "memory.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct sim86 *sim86_create() { return calloc(1, sizeof(struct sim86)); }
+
+void sim86_destroy(struct sim86 *sim) {
+  if (sim == NULL) {
+    return;
+  }
+
+  if (sim->blocks != NULL) {
+    jit_free(sim->blocks);
+  }
+
+  watchdog_free(sim);
+  cache_free(sim);
+  free(sim->blocks);
+  free(sim);
+}
+
+bool sim86_apply_preset(struct sim86 *sim, char *token) {
+  char *value = strchr(token, '=');
+  if (value == NULL) {
+    return false;
+  }
+  *value++ = '\0';
+
+  uint16_t v = strtol(value, NULL, 0);
+  bool is_byte = strncmp(token, "byte[", 5) == 0;
+
+  if (token[0] == '[' || is_byte) {
+    uint16_t addr = strtol(strchr(token, '[') + 1, NULL, 0);
+
+    if (is_byte) {
+      mem_save_byte(sim, addr, v);
+    } else {
+      mem_save_word(sim, addr, v);
+    }
+
+    return true;
+  }
+
+  for (int i = 0; i < 36; ++i) {
+    if (strcmp(token, reg_names[i]) == 0) {
+      /* names from sp on have no byte halves, only first entry matches */
+      struct register_access reg = {i / 3 + 1, i < 12 ? i % 3 : RegByte_All};
+      set_register(sim, reg, v);
+      return true;
+    }
+  }
+
+  return false;
+}
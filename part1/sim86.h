@@ -0,0 +1,69 @@
+#ifndef SIM86_H
+#define SIM86_H
+
+#include "execute.h"
+#include "flags.h"
+#include "icache.h"
+#include "io.h"
+#include "memory.h"
+#include "watchdog.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+struct block_cache;
+struct cache_state;
+
+/*
+One simulated machine. Everything an instruction can change lives here, so
+any number of machines can run side by side, one per thread. Diagnostics
+(trace, profile, branch statistics, BIU model) stay process wide and are
+meant for single machine runs, only the cache model counts per machine.
+*/
+struct sim86 {
+  uint8_t memory[MEM_SIZE];
+  uint64_t mem_dirty[MEM_DIRTY_WORDS];   /* pages written since delta capture */
+  uint64_t mem_touched[MEM_DIRTY_WORDS]; /* pages written since mem_snapshot() */
+
+  /*
+  0 - al, ah, ax
+  1 - bl, bh, bx
+  2 - cl, ch, cx
+  3 - dl, dh, dx
+  4 - sp
+  5 - bp
+  6 - si
+  7 - di
+  8 - es
+  9 - cs
+  10 - ss
+  11 - ds
+  Segment registers are only stored, memory stays a flat 64 KB.
+  */
+  uint16_t regs[SIM_REGISTER_COUNT];
+  uint16_t ip;
+  struct lazy_flags flags;
+  uint64_t total_clocks;
+  uint64_t instructions; /* retired by interpreter and blocks together */
+  bool divide_error; /* DIV or IDIV stopped program, 8086 raises INT 0 */
+
+  /* state after previous instruction, used to print what changed */
+  struct register_state previous;
+
+  struct icache icache;
+  struct block_cache *blocks; /* allocated by first block_run() */
+  struct cache_state *cache;  /* allocated by first access with --cache */
+  struct watchdog_state watch;
+  struct io_state io; /* devices behind IN and OUT */
+};
+
+/* Returns zeroed machine, or NULL when it cannot be allocated. */
+struct sim86 *sim86_create();
+void sim86_destroy(struct sim86 *sim);
+
+/*
+Applies one input token: "ax=5" sets a register, "[1000]=7" stores a word
+and "byte[1000]=7" stores a byte. Returns false for unknown tokens.
+*/
+bool sim86_apply_preset(struct sim86 *sim, char *token);
+
+#endif // SIM86_H
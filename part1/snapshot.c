@@ -0,0 +1,33 @@
+#include "snapshot.h"
+#include "execute.h"
+#include "memory.h"
+#include "sim86.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+void snapshot_take(struct sim86 *sim, struct machine_snapshot *snapshot) {
+  if (snapshot->memory == NULL) {
+    snapshot->memory = malloc(MEM_SIZE);
+  }
+
+  mem_snapshot(sim, snapshot->memory);
+  get_register_state(sim, &snapshot->registers);
+  memcpy(snapshot->segments, &sim->regs[8], sizeof(snapshot->segments));
+  snapshot->total_clocks = sim->total_clocks;
+  snapshot->io = sim->io;
+}
+
+uint16_t snapshot_restore(struct sim86 *sim,
+                          struct machine_snapshot *snapshot) {
+  set_register_state(sim, &snapshot->registers);
+  memcpy(&sim->regs[8], snapshot->segments, sizeof(snapshot->segments));
+  sim->total_clocks = snapshot->total_clocks;
+  sim->io = snapshot->io;
+  return mem_rollback(sim, snapshot->memory);
+}
+
+void snapshot_free(struct machine_snapshot *snapshot) {
+  free(snapshot->memory);
+  snapshot->memory = NULL;
+}
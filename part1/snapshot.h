@@ -0,0 +1,30 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "execute.h"
+#include "io.h"
+#include <stdint.h>
+
+struct sim86;
+
+/*
+Whole machine state. Memory is copied once when the snapshot is taken;
+restoring copies back only the pages written since then.
+*/
+struct machine_snapshot {
+  uint8_t *memory;
+  struct register_state registers;
+  uint16_t segments[4]; /* ES, CS, SS and DS, not part of registers */
+  uint64_t total_clocks;
+  struct io_state io;
+};
+
+void snapshot_take(struct sim86 *sim, struct machine_snapshot *snapshot);
+
+/* Returns number of memory pages that had to be restored. */
+uint16_t snapshot_restore(struct sim86 *sim,
+                          struct machine_snapshot *snapshot);
+
+void snapshot_free(struct machine_snapshot *snapshot);
+
+#endif // SNAPSHOT_H
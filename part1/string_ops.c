@@ -0,0 +1,179 @@
+#include "string_ops.h"
+#include "cache.h"
+#include "clocks.h"
+#include "execute.h"
+#include "flags.h"
+#include "instruction.h"
+#include "memory.h"
+#include "sim86.h"
+#include "trace.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+bool is_string(enum instruction_type type) {
+  return type >= INST_MOVS && type <= INST_STOS;
+}
+
+uint16_t string_load(struct sim86 *sim, uint16_t addr, uint16_t width) {
+  return width == 2 ? mem_read_word(sim, addr) : mem_read_byte(sim, addr);
+}
+
+void string_store(struct sim86 *sim, uint16_t addr, uint16_t value,
+                  uint16_t width) {
+  if (width == 2) {
+    mem_save_word(sim, addr, value);
+  } else {
+    mem_save_byte(sim, addr, value);
+  }
+}
+
+void string_set_accumulator(struct sim86 *sim, uint16_t value,
+                            uint16_t width) {
+  uint16_t *ax = &sim->regs[Reg_A - 1];
+  *ax = width == 2 ? value : (*ax & 0xff00) | value;
+}
+
+/* One iteration, SI and DI move by step. */
+void string_step(struct sim86 *sim, enum instruction_type type,
+                 uint16_t width, int16_t step) {
+  uint16_t *ax = &sim->regs[Reg_A - 1];
+  uint16_t *si = &sim->regs[Reg_SI - 1];
+  uint16_t *di = &sim->regs[Reg_DI - 1];
+
+  switch (type) {
+  case INST_MOVS: {
+    string_store(sim, *di, string_load(sim, *si, width), width);
+    *si += step;
+    *di += step;
+  } break;
+
+  case INST_CMPS: {
+    alu_sub(sim, string_load(sim, *si, width), string_load(sim, *di, width),
+            width);
+    *si += step;
+    *di += step;
+  } break;
+
+  case INST_SCAS: {
+    alu_sub(sim, mask_value(*ax, width), string_load(sim, *di, width), width);
+    *di += step;
+  } break;
+
+  case INST_LODS: {
+    string_set_accumulator(sim, string_load(sim, *si, width), width);
+    *si += step;
+  } break;
+
+  case INST_STOS: {
+    string_store(sim, *di, mask_value(*ax, width), width);
+    *di += step;
+  } break;
+
+  default:
+    break;
+  }
+}
+
+/*
+Runs count iterations of MOVS, STOS or LODS at once. Returns false, having
+changed nothing, when a range wraps around end of memory or when MOVS would
+read bytes it wrote itself: that repeats a pattern instead of copying, so
+it has to go one element at a time.
+*/
+bool string_bulk(struct sim86 *sim, enum instruction_type type,
+                 uint16_t width, int16_t step, uint32_t count) {
+  uint16_t *ax = &sim->regs[Reg_A - 1];
+  uint16_t *si = &sim->regs[Reg_SI - 1];
+  uint16_t *di = &sim->regs[Reg_DI - 1];
+
+  int32_t bytes = count * width;
+  int32_t shift = step * (int32_t)count;
+
+  /* lowest byte of each range, going down it ends at the first element */
+  int32_t src = step > 0 ? *si : *si + width - bytes;
+  int32_t dst = step > 0 ? *di : *di + width - bytes;
+  bool dst_wraps = dst < 0 || dst + bytes > MEM_SIZE;
+
+  switch (type) {
+  case INST_LODS: {
+    /* only the last element stays in accumulator */
+    uint16_t last = *si + step * (int32_t)(count - 1);
+    string_set_accumulator(sim, string_load(sim, last, width), width);
+    *si += shift;
+  } break;
+
+  case INST_STOS: {
+    if (dst_wraps) {
+      return false;
+    }
+
+    mem_fill(sim, dst, count, mask_value(*ax, width), width);
+    *di += shift;
+  } break;
+
+  case INST_MOVS: {
+    bool src_wraps = src < 0 || src + bytes > MEM_SIZE;
+    bool feeds_back = step > 0 ? *di > *si && *di < *si + bytes
+                               : *di < *si && *di + bytes > *si;
+
+    if (src_wraps || dst_wraps || feeds_back) {
+      return false;
+    }
+
+    mem_move(sim, dst, src, bytes);
+    *si += shift;
+    *di += shift;
+  } break;
+
+  default:
+    return false;
+  }
+
+  return true;
+}
+
+void execute_string(struct sim86 *sim, struct instruction *instruction,
+                    struct timing_state *state) {
+  enum instruction_type type = instruction->type;
+  uint16_t width = instruction->flags & F_W ? 2 : 1;
+  int16_t step = flag_is_set(sim, DF) ? -width : width;
+  uint16_t *cx = &sim->regs[Reg_C - 1];
+
+  state->address = sim->regs[Reg_SI - 1];
+  state->destination = sim->regs[Reg_DI - 1];
+
+  if (!(instruction->prefixes & (PREFIX_REP | PREFIX_REPNE))) {
+    string_step(sim, type, width, step);
+    state->repetitions = 1;
+    return;
+  }
+
+  bool compares = type == INST_CMPS || type == INST_SCAS;
+  uint32_t count = *cx;
+
+  /* accesses have to be seen one by one when logged, traced or cached */
+  bool bulk =
+      !compares && !mem_log_writes && !trace_enabled && !cache_enabled;
+
+  if (bulk && count != 0 && string_bulk(sim, type, width, step, count)) {
+    *cx = 0;
+    state->repetitions = count;
+    return;
+  }
+
+  /* REPE stops at first difference, REPNE at first match */
+  bool stop_on_zero = instruction->prefixes & PREFIX_REPNE;
+  uint32_t repetitions = 0;
+
+  while (*cx != 0) {
+    string_step(sim, type, width, step);
+    --*cx;
+    repetitions++;
+
+    if (compares && flag_is_set(sim, ZF) == stop_on_zero) {
+      break;
+    }
+  }
+
+  state->repetitions = repetitions;
+}
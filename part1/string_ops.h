@@ -0,0 +1,23 @@
+#ifndef STRING_OPS_H
+#define STRING_OPS_H
+
+#include "clocks.h"
+#include "instruction.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+struct sim86;
+
+/* MOVS, CMPS, SCAS, LODS and STOS */
+bool is_string(enum instruction_type type);
+
+/*
+Runs string instruction with its repeat prefix, stepping SI and DI up or
+down by DF. Memory is flat, so segment overrides change nothing here.
+Fills registers the instruction started with and number of iterations
+into state for timing.
+*/
+void execute_string(struct sim86 *sim, struct instruction *instruction,
+                    struct timing_state *state);
+
+#endif // STRING_OPS_H
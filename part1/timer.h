@@ -0,0 +1,12 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+/* monotonic host time in nanoseconds */
+uint64_t read_timer_ns();
+
+/* host CPU time used by calling thread in nanoseconds */
+uint64_t read_thread_cpu_ns();
+
+#endif // TIMER_H
@@ -0,0 +1,159 @@
+#include "timing_model.h"
+#include "biu.h"
+#include "clocks.h"
+#include "sim86.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool timing_models_enabled = false;
+
+struct timing_model timing_models[TIMING_MAX_MODELS];
+uint16_t timing_model_count = 0;
+
+void timing_table_step(struct timing_model *model,
+                       struct timing_event *event) {
+  model->clocks += event->clocks +
+                   bus_penalty(&model->bus, event->instruction, event->state);
+}
+
+void timing_prefetch_step(struct timing_model *model,
+                          struct timing_event *event) {
+  struct instruction *instruction = event->instruction;
+  uint32_t clocks =
+      event->clocks + bus_penalty(&model->bus, instruction, event->state);
+
+  biu_instruction(&model->biu, instruction->bsize, clocks,
+                  bus_cycles(&model->bus, instruction, event->state),
+                  event->taken);
+  model->clocks = model->biu.stats.clocks;
+}
+
+struct timing_model *timing_model_add(struct bus_model bus, bool prefetch) {
+  if (timing_model_count == TIMING_MAX_MODELS) {
+    return NULL;
+  }
+
+  struct timing_model *model = &timing_models[timing_model_count++];
+  *model = (struct timing_model){
+      .bus = bus,
+      .step = prefetch ? timing_prefetch_step : timing_table_step,
+  };
+
+  int length = snprintf(model->name, sizeof(model->name), "%s",
+                        bus.cpu == CPU_8088 ? "8088" : "8086");
+  if (bus.wait_states != 0) {
+    length += snprintf(model->name + length, sizeof(model->name) - length,
+                       " %uws", bus.wait_states);
+  }
+
+  if (prefetch) {
+    snprintf(model->name + length, sizeof(model->name) - length,
+             " prefetch");
+  }
+
+  biu_reset(&model->biu, bus);
+  timing_models_enabled = true;
+
+  return model;
+}
+
+/* Parses one CPU[:WAIT_STATES][:prefetch] and moves spec past it. */
+bool timing_parse_model(char **spec, struct bus_model *bus, bool *prefetch) {
+  if (strncmp(*spec, "8086", 4) == 0) {
+    bus->cpu = CPU_8086;
+  } else if (strncmp(*spec, "8088", 4) == 0) {
+    bus->cpu = CPU_8088;
+  } else {
+    return false;
+  }
+
+  *spec += 4;
+  bus->wait_states = 0;
+  *prefetch = false;
+
+  if (**spec == ':' && (*spec)[1] >= '0' && (*spec)[1] <= '9') {
+    char *end = NULL;
+    unsigned long wait_states = strtoul(*spec + 1, &end, 10);
+    if (wait_states > UINT16_MAX) {
+      return false;
+    }
+
+    bus->wait_states = wait_states;
+    *spec = end;
+  }
+
+  if (strncmp(*spec, ":prefetch", 9) == 0) {
+    *prefetch = true;
+    *spec += 9;
+  }
+
+  return **spec == ',' || **spec == '\0';
+}
+
+bool timing_sweep_configure(char *spec) {
+  struct bus_model buses[TIMING_MAX_MODELS];
+  bool prefetch[TIMING_MAX_MODELS];
+  uint16_t count = 0;
+
+  if (*spec == '\0') {
+    for (int i = 0; i < 8; ++i) {
+      buses[i] = (struct bus_model){i < 4 ? CPU_8086 : CPU_8088, i / 2 % 2};
+      prefetch[i] = i % 2;
+    }
+
+    count = 8;
+  }
+
+  while (*spec) {
+    if (count == TIMING_MAX_MODELS ||
+        !timing_parse_model(&spec, &buses[count], &prefetch[count])) {
+      return false;
+    }
+
+    count++;
+    spec += *spec == ',';
+  }
+
+  if (timing_model_count + count > TIMING_MAX_MODELS) {
+    return false;
+  }
+
+  for (uint16_t i = 0; i < count; ++i) {
+    timing_model_add(buses[i], prefetch[i])->sweep = true;
+  }
+
+  return true;
+}
+
+void timing_models_record(struct timing_event *event) {
+  for (uint16_t i = 0; i < timing_model_count; ++i) {
+    timing_models[i].step(&timing_models[i], event);
+  }
+}
+
+void timing_sweep_print_report(struct sim86 *sim) {
+  uint64_t table_clocks = sim->total_clocks;
+  uint64_t instructions = sim->instructions;
+
+  printf("\nTiming sweep:\n");
+  printf("\tinstructions: %llu, clocks of run: %llu\n",
+         (unsigned long long)instructions, (unsigned long long)table_clocks);
+  printf("\tmodel                      clocks  per instruction   vs run\n");
+
+  for (uint16_t i = 0; i < timing_model_count; ++i) {
+    struct timing_model *model = &timing_models[i];
+    if (!model->sweep) {
+      continue;
+    }
+
+    printf("\t  %-18s %12llu %16.2f  %+6.1f%%\n", model->name,
+           (unsigned long long)model->clocks,
+           instructions ? (double)model->clocks / instructions : 0.0,
+           table_clocks ? 100.0 * ((double)model->clocks - table_clocks) /
+                              table_clocks
+                        : 0.0);
+  }
+}
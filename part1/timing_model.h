@@ -0,0 +1,61 @@
+#ifndef TIMING_MODEL_H
+#define TIMING_MODEL_H
+
+#include "biu.h"
+#include "clocks.h"
+#include "instruction.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TIMING_MAX_MODELS 16
+
+/*
+One executed instruction as every timing model sees it. The functional
+simulation runs once and each model turns its events into clocks of its
+own bus, so a model costs only its per-event work.
+*/
+struct timing_event {
+  struct instruction *instruction;
+  struct timing_state *state; /* addresses, branch taken, repetitions */
+  uint32_t clocks;            /* table clocks without bus penalty */
+  bool taken;                 /* control went elsewhere than next instruction */
+};
+
+struct sim86;
+struct timing_model;
+
+/* Accounts one event in model->clocks. */
+typedef void (*timing_model_step)(struct timing_model *,
+                                  struct timing_event *);
+
+struct timing_model {
+  char name[32];
+  struct bus_model bus;
+  timing_model_step step;
+  uint64_t clocks;
+  bool sweep;     /* listed in sweep report */
+  struct biu biu; /* prefetch queue of prefetch models */
+};
+
+/* set while at least one model is added */
+extern bool timing_models_enabled;
+
+/*
+Adds model of bus, counting table clocks plus bus penalty, or running them
+through a prefetch queue model. Returns NULL when there is no room left.
+*/
+struct timing_model *timing_model_add(struct bus_model bus, bool prefetch);
+
+/*
+Adds models of comma separated CPU[:WAIT_STATES][:prefetch] list, or of
+both CPUs with 0 and 1 wait states, with and without prefetch, for an
+empty one. Returns false when spec is malformed.
+*/
+bool timing_sweep_configure(char *spec);
+
+void timing_models_record(struct timing_event *event);
+
+/* Prints clocks of every sweep model next to total_clocks of the run. */
+void timing_sweep_print_report(struct sim86 *sim);
+
+#endif // TIMING_MODEL_H
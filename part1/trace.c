@@ -0,0 +1,251 @@
+#include "trace.h"
+#include "clocks.h"
+#include "execute.h"
+#include "memory.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_BUF_SIZE (4 * 1024 * 1024)
+/* largest record: instruction with every field present */
+#define TRACE_MAX_RECORD 64
+
+bool trace_enabled = false;
+
+FILE *trace_file = NULL;
+uint8_t *trace_buf = NULL;
+size_t trace_len = 0;
+
+void trace_flush() {
+  fwrite(trace_buf, 1, trace_len, trace_file);
+  trace_len = 0;
+}
+
+void trace_reserve(size_t n) {
+  if (trace_len + n > TRACE_BUF_SIZE) {
+    trace_flush();
+  }
+}
+
+void trace_put_u8(uint8_t value) { trace_buf[trace_len++] = value; }
+
+void trace_put_u16(uint16_t value) {
+  trace_buf[trace_len++] = value;
+  trace_buf[trace_len++] = value >> 8;
+}
+
+void trace_put(const void *src, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    trace_reserve(1);
+    trace_put_u8(((const uint8_t *)src)[i]);
+  }
+}
+
+bool trace_open(struct sim86 *sim, const char *path, const char *name,
+                uint16_t image_size) {
+  trace_file = fopen(path, "wb");
+  if (trace_file == NULL) {
+    return false;
+  }
+
+  trace_buf = malloc(TRACE_BUF_SIZE);
+  trace_len = 0;
+  trace_enabled = true;
+
+  uint16_t name_len = strlen(name);
+  trace_put(TRACE_MAGIC, 4);
+  trace_reserve(4);
+  trace_put_u16(TRACE_VERSION);
+  trace_put_u16(name_len);
+  trace_put(name, name_len);
+
+  uint32_t size = image_size;
+  trace_reserve(4);
+  trace_put_u16(size);
+  trace_put_u16(size >> 16);
+
+  uint8_t buf[1024];
+  for (uint32_t at = 0; at < size; at += sizeof(buf)) {
+    uint32_t n = size - at < sizeof(buf) ? size - at : sizeof(buf);
+    mem_readn(sim, at, buf, n);
+    trace_put(buf, n);
+  }
+
+  return true;
+}
+
+void trace_instruction(struct register_state *before,
+                       struct register_state *after, uint8_t bsize,
+                       struct instruction_timing *timing) {
+  uint16_t changes = 0;
+
+  for (int i = 0; i < 8; ++i) {
+    if (before->regs[i] != after->regs[i]) {
+      changes |= 1 << i;
+    }
+  }
+
+  if (timing->ea != 0) {
+    changes |= TRACE_EA;
+  }
+
+  if (timing->penalty != 0) {
+    changes |= TRACE_PENALTY;
+  }
+
+  if ((uint16_t)(before->ip + bsize) != after->ip) {
+    changes |= TRACE_JUMP;
+  }
+
+  if (before->flags != after->flags) {
+    changes |= TRACE_FLAGS;
+  }
+
+  if (timing->min > UINT16_MAX) {
+    changes |= TRACE_LONG;
+  }
+
+  if (timing->max != timing->min) {
+    changes |= TRACE_RANGE;
+  }
+
+  trace_reserve(TRACE_MAX_RECORD);
+  trace_put_u8(TRACE_INSTRUCTION);
+  trace_put_u16(before->ip);
+  trace_put_u8(bsize);
+  trace_put_u16(changes);
+  trace_put_u16(timing->min);
+  if (changes & TRACE_LONG) {
+    trace_put_u16(timing->min >> 16);
+  }
+
+  if (changes & TRACE_EA) {
+    trace_put_u16(timing->ea);
+  }
+
+  if (changes & TRACE_PENALTY) {
+    trace_put_u16(timing->penalty);
+    if (changes & TRACE_LONG) {
+      trace_put_u16(timing->penalty >> 16);
+    }
+  }
+
+  if (changes & TRACE_RANGE) {
+    trace_put_u16(timing->max - timing->min);
+  }
+
+  if (changes & TRACE_JUMP) {
+    trace_put_u16(after->ip);
+  }
+
+  if (changes & TRACE_FLAGS) {
+    trace_put_u16(before->flags);
+    trace_put_u16(after->flags);
+  }
+
+  for (int i = 0; i < 8; ++i) {
+    if (changes & (1 << i)) {
+      trace_put_u16(after->regs[i]);
+    }
+  }
+}
+
+void trace_write(uint16_t addr, uint16_t value, uint8_t width) {
+  trace_reserve(TRACE_MAX_RECORD);
+  trace_put_u8(TRACE_WRITE);
+  trace_put_u16(addr);
+  trace_put_u8(width);
+  trace_put_u16(value);
+}
+
+void trace_unsupported(uint16_t ip) {
+  trace_reserve(TRACE_MAX_RECORD);
+  trace_put_u8(TRACE_UNSUPPORTED);
+  trace_put_u16(ip);
+}
+
+void trace_divide_error(uint16_t ip) {
+  trace_reserve(TRACE_MAX_RECORD);
+  trace_put_u8(TRACE_DIVIDE_ERROR);
+  trace_put_u16(ip);
+}
+
+void trace_close(struct register_state *state, uint64_t total_clocks) {
+  trace_reserve(TRACE_MAX_RECORD);
+  trace_put_u8(TRACE_END);
+
+  for (int i = 0; i < 8; ++i) {
+    trace_put_u16(state->regs[i]);
+  }
+
+  trace_put_u16(state->ip);
+  trace_put_u16(state->flags);
+
+  for (int i = 0; i < 8; ++i) {
+    trace_put_u8(total_clocks >> (8 * i));
+  }
+
+  trace_flush();
+  fclose(trace_file);
+  free(trace_buf);
+
+  trace_file = NULL;
+  trace_buf = NULL;
+  trace_enabled = false;
+}
+
+bool trace_reader_open(struct trace_reader *reader, const char *path) {
+  reader->f = fopen(path, "rb");
+  if (reader->f == NULL) {
+    return false;
+  }
+
+  reader->buf = malloc(TRACE_BUF_SIZE);
+  reader->size = 0;
+  reader->pos = 0;
+  return true;
+}
+
+bool trace_read(struct trace_reader *reader, void *dst, size_t n) {
+  uint8_t *out = dst;
+
+  while (n > 0) {
+    if (reader->pos == reader->size) {
+      reader->size = fread(reader->buf, 1, TRACE_BUF_SIZE, reader->f);
+      reader->pos = 0;
+
+      if (reader->size == 0) {
+        return false;
+      }
+    }
+
+    size_t available = reader->size - reader->pos;
+    size_t chunk = n < available ? n : available;
+    memcpy(out, reader->buf + reader->pos, chunk);
+
+    reader->pos += chunk;
+    out += chunk;
+    n -= chunk;
+  }
+
+  return true;
+}
+
+uint8_t trace_read_u8(struct trace_reader *reader) {
+  uint8_t value = 0;
+  trace_read(reader, &value, 1);
+  return value;
+}
+
+uint16_t trace_read_u16(struct trace_reader *reader) {
+  uint8_t bytes[2] = {0};
+  trace_read(reader, bytes, 2);
+  return bytes[0] | (bytes[1] << 8);
+}
+
+void trace_reader_close(struct trace_reader *reader) {
+  fclose(reader->f);
+  free(reader->buf);
+}
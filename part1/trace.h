@@ -0,0 +1,79 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "clocks.h"
+#include "execute.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+Binary execution trace, little endian:
+
+header:      "S86T", u16 version, u16 name length, name,
+             u32 image size, image bytes loaded at address 0
+instruction: u8 TRACE_INSTRUCTION, u16 ip, u8 bsize, u16 changes, u16 clocks,
+             [u16 ea], [u16 bus penalty], [u16 ip after], [u16 flags before, u16 flags after],
+             u16 value for every changed register
+             with TRACE_LONG clocks and bus penalty are u32,
+             with TRACE_RANGE u16 max - min clocks follows them
+write:       u8 TRACE_WRITE, u16 address, u8 width, u16 value
+unsupported: u8 TRACE_UNSUPPORTED, u16 ip
+divide:      u8 TRACE_DIVIDE_ERROR, u16 ip
+end:         u8 TRACE_END, 8 x u16 registers, u16 ip, u16 flags,
+             u64 total clocks
+
+Writes belong to the instruction record that follows them.
+*/
+
+#define TRACE_MAGIC "S86T"
+#define TRACE_VERSION 5
+
+enum trace_record_type : uint8_t {
+  TRACE_INSTRUCTION = 1,
+  TRACE_WRITE,
+  TRACE_UNSUPPORTED,
+  TRACE_END,
+  TRACE_DIVIDE_ERROR, /* DIV or IDIV stopped program */
+};
+
+enum trace_change : uint16_t {
+  TRACE_REGS = 0xff,  /* one bit per changed register */
+  TRACE_EA = 1 << 8,  /* ea part of clocks is stored */
+  TRACE_JUMP = 1 << 9, /* ip after is not ip + bsize */
+  TRACE_FLAGS = 1 << 10,
+  TRACE_PENALTY = 1 << 11, /* bus penalty part of clocks is stored */
+  TRACE_LONG = 1 << 12,    /* clocks do not fit u16, repeated strings */
+  TRACE_RANGE = 1 << 13,   /* clocks depend on data, MUL and DIV */
+};
+
+struct sim86;
+
+extern bool trace_enabled;
+
+/* Starts trace of sim, image_size bytes of its memory are the program. */
+bool trace_open(struct sim86 *sim, const char *path, const char *name,
+                uint16_t image_size);
+void trace_instruction(struct register_state *before,
+                       struct register_state *after, uint8_t bsize,
+                       struct instruction_timing *timing);
+void trace_write(uint16_t addr, uint16_t value, uint8_t width);
+void trace_unsupported(uint16_t ip);
+void trace_divide_error(uint16_t ip);
+void trace_close(struct register_state *state, uint64_t total_clocks);
+
+/* buffered sequential reader used by the renderer */
+struct trace_reader {
+  FILE *f;
+  uint8_t *buf;
+  size_t size;
+  size_t pos;
+};
+
+bool trace_reader_open(struct trace_reader *reader, const char *path);
+bool trace_read(struct trace_reader *reader, void *dst, size_t n);
+uint8_t trace_read_u8(struct trace_reader *reader);
+uint16_t trace_read_u16(struct trace_reader *reader);
+void trace_reader_close(struct trace_reader *reader);
+
+#endif // TRACE_H
@@ -0,0 +1,245 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decode.h"
+#include "display.h"
+#include "execute.h"
+#include "memory.h"
+#include "sim86.h"
+#include "trace.h"
+
+/*
+Turns a trace written by `sim86 --trace=FILE` back into the text printed by
+`sim86 --exec`, or answers queries about it without rerunning the program.
+*/
+
+struct pending_write {
+  uint16_t addr;
+  uint8_t width;
+  uint16_t value;
+};
+
+struct pending_write *pending = NULL;
+size_t pending_count = 0;
+size_t pending_capacity = 0;
+
+void add_pending_write(struct pending_write write) {
+  if (pending_count == pending_capacity) {
+    pending_capacity = pending_capacity ? pending_capacity * 2 : 16;
+    pending = realloc(pending, pending_capacity * sizeof(*pending));
+  }
+
+  pending[pending_count++] = write;
+}
+
+void apply_pending_writes(struct sim86 *sim) {
+  for (size_t i = 0; i < pending_count; ++i) {
+    if (pending[i].width == 2) {
+      mem_save_word(sim, pending[i].addr, pending[i].value);
+    } else {
+      mem_save_byte(sim, pending[i].addr, pending[i].value);
+    }
+  }
+
+  pending_count = 0;
+}
+
+bool write_touches(struct pending_write *write, uint16_t addr) {
+  return (uint16_t)(addr - write->addr) < write->width;
+}
+
+int main(int argc, char **argv) {
+  char *path = NULL;
+  bool query_writes = false;
+  uint16_t query_addr = 0;
+
+  for (int arg_index = 1; arg_index < argc; ++arg_index) {
+    char *arg = argv[arg_index];
+
+    if (strncmp(arg, "--writes=", 9) == 0) {
+      query_writes = true;
+      query_addr = strtol(arg + 9, NULL, 0);
+    } else {
+      path = arg;
+      break;
+    }
+  }
+
+  if (path == NULL) {
+    fprintf(stderr, "usage: sim86_trace [--writes=ADDR] trace_file\n");
+    exit(1);
+  }
+
+  struct trace_reader reader;
+  if (!trace_reader_open(&reader, path)) {
+    fprintf(stderr, "Cannot open file \"%s\", errno = %d\n.", path, errno);
+    exit(1);
+  }
+
+  char magic[4];
+  trace_read(&reader, magic, 4);
+  uint16_t version = trace_read_u16(&reader);
+
+  if (memcmp(magic, TRACE_MAGIC, 4) != 0 || version != TRACE_VERSION) {
+    fprintf(stderr, "\"%s\" is not a sim86 trace.\n", path);
+    exit(1);
+  }
+
+  uint16_t name_len = trace_read_u16(&reader);
+  char *name = calloc(name_len + 1, 1);
+  trace_read(&reader, name, name_len);
+
+  uint32_t image_size = trace_read_u16(&reader);
+  image_size |= (uint32_t)trace_read_u16(&reader) << 16;
+
+  struct sim86 *sim = sim86_create();
+
+  mem_log_writes = false;
+  for (uint32_t i = 0; i < image_size; ++i) {
+    mem_save_byte(sim, i, trace_read_u8(&reader));
+  }
+
+  if (!query_writes) {
+    printf("--- execute: %s ---\n", name);
+    mem_log_writes = true;
+  }
+
+  struct register_state state = {0};
+  uint64_t clocks = 0;
+  uint64_t index = 0;
+  uint8_t type = 0;
+
+  while (trace_read(&reader, &type, 1)) {
+    switch (type) {
+    case TRACE_WRITE: {
+      struct pending_write write;
+      write.addr = trace_read_u16(&reader);
+      write.width = trace_read_u8(&reader);
+      write.value = trace_read_u16(&reader);
+      add_pending_write(write);
+    } break;
+
+    case TRACE_INSTRUCTION: {
+      struct register_state after = state;
+      struct instruction_timing timing = {0};
+
+      uint16_t at = trace_read_u16(&reader);
+      uint8_t bsize = trace_read_u8(&reader);
+      uint16_t changes = trace_read_u16(&reader);
+      timing.min = trace_read_u16(&reader);
+      if (changes & TRACE_LONG) {
+        timing.min |= (uint32_t)trace_read_u16(&reader) << 16;
+      }
+
+      if (changes & TRACE_EA) {
+        timing.ea = trace_read_u16(&reader);
+      }
+
+      if (changes & TRACE_PENALTY) {
+        timing.penalty = trace_read_u16(&reader);
+        if (changes & TRACE_LONG) {
+          timing.penalty |= (uint32_t)trace_read_u16(&reader) << 16;
+        }
+      }
+      timing.max = timing.min;
+      if (changes & TRACE_RANGE) {
+        timing.max += trace_read_u16(&reader);
+      }
+
+      timing.base_min = timing.min - timing.ea - timing.penalty;
+      timing.base_max = timing.max - timing.ea - timing.penalty;
+
+      after.ip = at + bsize;
+      if (changes & TRACE_JUMP) {
+        after.ip = trace_read_u16(&reader);
+      }
+
+      if (changes & TRACE_FLAGS) {
+        state.flags = trace_read_u16(&reader);
+        after.flags = trace_read_u16(&reader);
+      }
+
+      for (int i = 0; i < 8; ++i) {
+        if (changes & (1 << i)) {
+          after.regs[i] = trace_read_u16(&reader);
+        }
+      }
+
+      clocks += timing.min;
+
+      if (query_writes) {
+        for (size_t i = 0; i < pending_count; ++i) {
+          if (write_touches(&pending[i], query_addr)) {
+            printf("#%llu ip 0x%x: [0x%x] %s <- %d\n",
+                   (unsigned long long)index, at, pending[i].addr,
+                   pending[i].width == 2 ? "word" : "byte", pending[i].value);
+          }
+        }
+
+        apply_pending_writes(sim);
+      } else {
+        struct instruction instruction = {0};
+        decode_instruction(sim, at, &instruction);
+        print_instruction(&instruction);
+
+        apply_pending_writes(sim);
+        print_state_change(&timing, clocks, &state, &after);
+        printf("\n");
+      }
+
+      state = after;
+      index++;
+    } break;
+
+    case TRACE_UNSUPPORTED:
+    case TRACE_DIVIDE_ERROR: {
+      uint16_t at = trace_read_u16(&reader);
+
+      if (!query_writes) {
+        struct instruction instruction = {0};
+        decode_instruction(sim, at, &instruction);
+        print_instruction(&instruction);
+        printf("%s\n", type == TRACE_DIVIDE_ERROR ? "divide error"
+                                                   : "unsupported instruction");
+      }
+    } break;
+
+    case TRACE_END: {
+      struct register_state final = {0};
+
+      for (int i = 0; i < 8; ++i) {
+        final.regs[i] = trace_read_u16(&reader);
+      }
+
+      final.ip = trace_read_u16(&reader);
+      final.flags = trace_read_u16(&reader);
+
+      uint64_t total_clocks = 0;
+      for (int i = 0; i < 8; ++i) {
+        total_clocks |= (uint64_t)trace_read_u8(&reader) << (8 * i);
+      }
+
+      if (total_clocks != clocks) {
+        fprintf(stderr, "Trace clocks do not add up: %llu != %llu.\n",
+                (unsigned long long)clocks, (unsigned long long)total_clocks);
+      }
+
+      if (!query_writes) {
+        print_registers(&final);
+      }
+    } break;
+
+    default:
+      fprintf(stderr, "Corrupted trace record 0x%x.\n", type);
+      exit(1);
+    }
+  }
+
+  trace_reader_close(&reader);
+  sim86_destroy(sim);
+  return 0;
+}
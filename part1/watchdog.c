@@ -0,0 +1,203 @@
+#include "watchdog.h"
+#include "flags.h"
+#include "memory.h"
+#include "sim86.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct watchdog_config watchdog = {0};
+
+/* splitmix64 finalizer */
+uint64_t watchdog_mix(uint64_t value) {
+  value += 0x9E3779B97F4A7C15ull;
+  value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+  value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+  return value ^ (value >> 31);
+}
+
+uint64_t watchdog_byte_hash(uint16_t addr, uint8_t value) {
+  return watchdog_mix((uint64_t)addr << 8 | value);
+}
+
+void watchdog_hash_range(struct sim86 *sim, uint16_t addr, uint32_t n) {
+  for (uint32_t i = 0; i < n; ++i, ++addr) {
+    sim->watch.memory_hash ^= watchdog_byte_hash(addr, sim->memory[addr]);
+  }
+}
+
+uint64_t watchdog_state_hash(struct sim86 *sim) {
+  struct lazy_flags *flags = &sim->flags;
+  uint64_t words[4] = {0};
+  memcpy(&words[0], &sim->regs[0], 8);
+  memcpy(&words[1], &sim->regs[4], 8);
+  words[2] = sim->ip | (uint64_t)flags->op << 16 |
+             (uint64_t)flags->width << 32 | (uint64_t)flags->carry << 48;
+  words[3] = flags->a | (uint64_t)flags->b << 16 |
+             (uint64_t)flags->result << 32 | (uint64_t)flags->base << 48;
+
+  uint64_t hash = sim->watch.memory_hash;
+  for (int i = 0; i < 4; ++i) {
+    hash = watchdog_mix(hash ^ words[i]);
+  }
+
+  return hash;
+}
+
+/* Registers, ip and flags equal to saved ones, memory is left to caller. */
+bool watchdog_same_state(struct sim86 *sim) {
+  struct watchdog_state *watch = &sim->watch;
+  struct lazy_flags *a = &sim->flags;
+  struct lazy_flags *b = &watch->saved_flags;
+
+  return memcmp(sim->regs, watch->saved_regs, sizeof(sim->regs)) == 0 &&
+         sim->ip == watch->saved_ip && a->op == b->op &&
+         a->width == b->width && a->a == b->a && a->b == b->b &&
+         a->result == b->result && a->carry == b->carry && a->base == b->base;
+}
+
+void watchdog_start(struct sim86 *sim) {
+  struct watchdog_state *watch = &sim->watch;
+  uint8_t *saved_memory = watch->saved_memory;
+
+  *watch = (struct watchdog_state){
+      .start_instructions = sim->instructions,
+      .start_clocks = sim->total_clocks,
+      .saved_memory = saved_memory,
+      .power = 1,
+  };
+
+  if (watchdog.detect_hangs) {
+    watchdog_hash_range(sim, 0, MEM_SIZE);
+  }
+}
+
+bool watchdog_active() {
+  return watchdog.max_instructions != 0 || watchdog.max_clocks != 0 ||
+         watchdog.detect_hangs;
+}
+
+bool watchdog_would_reach(struct sim86 *sim, uint64_t instructions,
+                          uint64_t clocks) {
+  struct watchdog_state *watch = &sim->watch;
+
+  return (watchdog.max_instructions != 0 &&
+          sim->instructions + instructions - watch->start_instructions >=
+              watchdog.max_instructions) ||
+         (watchdog.max_clocks != 0 &&
+          sim->total_clocks + clocks - watch->start_clocks >=
+              watchdog.max_clocks);
+}
+
+bool watchdog_expired(struct sim86 *sim) {
+  struct watchdog_state *watch = &sim->watch;
+
+  if (watch->stop != STOP_NONE) {
+    return true;
+  }
+
+  if (watchdog.max_instructions != 0 &&
+      sim->instructions - watch->start_instructions >=
+          watchdog.max_instructions) {
+    watch->stop = STOP_INSTRUCTIONS;
+  } else if (watchdog.max_clocks != 0 &&
+             sim->total_clocks - watch->start_clocks >= watchdog.max_clocks) {
+    watch->stop = STOP_CLOCKS;
+  }
+
+  return watch->stop != STOP_NONE;
+}
+
+void watchdog_backward_branch(struct sim86 *sim, uint16_t ip, uint8_t bsize,
+                              uint16_t target) {
+  struct watchdog_state *watch = &sim->watch;
+  uint64_t hash = watchdog_state_hash(sim);
+  uint16_t end = ip + bsize;
+
+  /* range starts over whenever state is saved or forgotten */
+  bool first = watch->length == 0;
+  watch->low = first || target < watch->low ? target : watch->low;
+  watch->high = first || end > watch->high ? end : watch->high;
+  watch->length++;
+
+  /* hash only narrows it down, the saved state must match exactly */
+  if (watch->saved && hash == watch->saved_hash &&
+      watchdog_same_state(sim) &&
+      memcmp(sim->memory, watch->saved_memory, MEM_SIZE) == 0) {
+    watch->stop = STOP_HANG;
+    watch->period_instructions = sim->instructions - watch->saved_instructions;
+    watch->period_clocks = sim->total_clocks - watch->saved_clocks;
+    watch->period_branches = watch->length;
+    return;
+  }
+
+  if (watch->length < watch->power) {
+    return;
+  }
+
+  if (watch->saved_memory == NULL) {
+    watch->saved_memory = malloc(MEM_SIZE);
+  }
+
+  memcpy(watch->saved_memory, sim->memory, MEM_SIZE);
+  memcpy(watch->saved_regs, sim->regs, sizeof(sim->regs));
+  watch->saved_ip = sim->ip;
+  watch->saved_flags = sim->flags;
+  watch->saved_hash = hash;
+  watch->saved_instructions = sim->instructions;
+  watch->saved_clocks = sim->total_clocks;
+  watch->saved = true;
+  watch->power *= 2;
+  watch->length = 0;
+}
+
+void watchdog_forget(struct sim86 *sim) {
+  struct watchdog_state *watch = &sim->watch;
+
+  watch->saved = false;
+  watch->power = 1;
+  watch->length = 0;
+}
+
+char *watchdog_stop_name(struct sim86 *sim) {
+  switch (sim->watch.stop) {
+  case STOP_INSTRUCTIONS:
+    return "instruction limit";
+  case STOP_CLOCKS:
+    return "clock limit";
+  case STOP_HANG:
+    return "hang";
+  default:
+    return NULL;
+  }
+}
+
+void watchdog_print_report(struct sim86 *sim) {
+  struct watchdog_state *watch = &sim->watch;
+  if (watch->stop == STOP_NONE) {
+    return;
+  }
+
+  printf("\nStopped:\n");
+  printf("\treason: %s\n", watchdog_stop_name(sim));
+  printf("\tinstructions: %llu\n",
+         (unsigned long long)(sim->instructions - watch->start_instructions));
+  printf("\tclocks: %llu\n",
+         (unsigned long long)(sim->total_clocks - watch->start_clocks));
+
+  if (watch->stop == STOP_HANG) {
+    printf("\tloop: 0x%04x-0x%04x\n", watch->low, watch->high - 1);
+    printf("\tperiod: %llu instructions, %llu clocks, %llu backward "
+           "branches\n",
+           (unsigned long long)watch->period_instructions,
+           (unsigned long long)watch->period_clocks,
+           (unsigned long long)watch->period_branches);
+  }
+}
+
+void watchdog_free(struct sim86 *sim) {
+  free(sim->watch.saved_memory);
+  sim->watch.saved_memory = NULL;
+}
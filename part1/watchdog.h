@@ -0,0 +1,100 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include "execute.h"
+#include "flags.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* batch runs stop here unless --max-instructions says otherwise */
+#define WATCHDOG_BATCH_INSTRUCTIONS 1000000000ull
+
+struct sim86;
+
+/* Limits of one run, zero means unlimited. Shared by all machines. */
+struct watchdog_config {
+  uint64_t max_instructions;
+  uint64_t max_clocks;
+  bool detect_hangs;
+};
+
+extern struct watchdog_config watchdog;
+
+enum watchdog_stop {
+  STOP_NONE,
+  STOP_INSTRUCTIONS,
+  STOP_CLOCKS,
+  STOP_HANG,
+};
+
+/*
+Hang detection with Brent's cycle finding over machine states seen at taken
+backward branches. A state is registers, ip, pending flags operation and
+memory, which is tracked through a hash updated on every store. State is
+saved after 1, 2, 4, ... branches and the program hangs when a later branch
+finds exactly the saved state again, memory compared in full. Flags are
+compared as recorded rather than computed, which is stricter and cheaper.
+*/
+struct watchdog_state {
+  enum watchdog_stop stop;
+  uint64_t start_instructions; /* counters when run started */
+  uint64_t start_clocks;
+
+  uint64_t memory_hash; /* xor of a hash of every address and its byte */
+  uint64_t saved_hash;
+  uint16_t saved_regs[SIM_REGISTER_COUNT];
+  uint16_t saved_ip;
+  struct lazy_flags saved_flags;
+  uint8_t *saved_memory; /* NULL until first state is saved */
+  bool saved;            /* saved_* hold a state to compare against */
+  uint64_t saved_instructions;
+  uint64_t saved_clocks;
+  uint64_t power;  /* branches before state is saved again */
+  uint64_t length; /* branches since state was saved */
+  uint16_t low;    /* lowest branch target since state was saved */
+  uint16_t high;   /* end of highest branch since state was saved */
+
+  /* loop found, valid with STOP_HANG */
+  uint64_t period_instructions;
+  uint64_t period_clocks;
+  uint64_t period_branches;
+};
+
+/* Resets counters and hang detector, called before every run. */
+void watchdog_start(struct sim86 *sim);
+
+/* Whether any limit or hang detection is on. */
+bool watchdog_active();
+
+/*
+Whether running given number of further instructions taking given clocks
+would reach a limit. Does not stop anything.
+*/
+bool watchdog_would_reach(struct sim86 *sim, uint64_t instructions,
+                          uint64_t clocks);
+
+/* Records a limit that was reached, returns whether the run must stop. */
+bool watchdog_expired(struct sim86 *sim);
+
+/* Taken branch from branch at ip to target at or before it. */
+void watchdog_backward_branch(struct sim86 *sim, uint16_t ip, uint8_t bsize,
+                              uint16_t target);
+
+/*
+Drops saved state after the program read something outside the machine,
+such as a timer, so states seen before cannot prove a hang.
+*/
+void watchdog_forget(struct sim86 *sim);
+
+/* Moves bytes [addr, addr + n) in or out of memory hash. */
+void watchdog_hash_range(struct sim86 *sim, uint16_t addr, uint32_t n);
+
+/* Short reason for stopping, NULL when run was not stopped. */
+char *watchdog_stop_name(struct sim86 *sim);
+
+/* Prints why run stopped, nothing when it was not stopped. */
+void watchdog_print_report(struct sim86 *sim);
+
+void watchdog_free(struct sim86 *sim);
+
+#endif // WATCHDOG_H